@@ -0,0 +1,118 @@
+#include "bench.hpp"
+#include <audio_mixer.hpp>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <numbers>
+#include <vector>
+
+namespace libved::bench {
+namespace {
+constexpr std::size_t sample_rate = 48000;
+constexpr std::size_t period = 1024;
+
+// One second of a sine per channel, which every track plays in a loop. The
+// source copies like a decoded track would, without the decoding.
+class synthetic_track {
+public:
+  explicit synthetic_track(const std::vector<float> &signal)
+      : m_signal{&signal} {}
+
+  std::size_t operator()(std::span<float *const> planes, std::size_t samples) {
+    for (std::size_t done = 0; done < samples;) {
+      const auto n = std::min(samples - done, m_signal->size() - m_position);
+      for (auto *plane : planes) {
+        std::copy_n(m_signal->data() + m_position, n, plane + done);
+      }
+      m_position = (m_position + n) % m_signal->size();
+      done += n;
+    }
+    return samples;
+  }
+
+private:
+  const std::vector<float> *m_signal;
+  std::size_t m_position = 0;
+};
+
+// Mixes `seconds` of audio from `tracks` stereo tracks with a gain and pan
+// ramp every 100ms, and returns how many times faster than real time that
+// was.
+double realtime_factor(const char *kernel, std::size_t tracks,
+                       const std::vector<float> &signal, double seconds) {
+  audio_mixer mixer{{.kernel = kernel}};
+  for (std::size_t i = 0; i < tracks; ++i) {
+    const auto id = mixer.add_track(synthetic_track{signal}, 2);
+    std::vector<automation_point> points;
+    const auto total = static_cast<std::int64_t>(seconds * sample_rate);
+    for (std::int64_t at = 0; at <= total; at += sample_rate / 10) {
+      const bool odd = (at / (sample_rate / 10)) % 2 != 0;
+      points.push_back({.sample = at,
+                        .gain = odd ? 0.5F : 1.0F,
+                        .pan = odd ? -0.5F : 0.5F});
+    }
+    mixer.set_automation(id, std::move(points));
+  }
+
+  std::vector<float> left(period);
+  std::vector<float> right(period);
+  const std::array<float *, 2> planes{left.data(), right.data()};
+  const auto periods =
+      static_cast<std::size_t>(seconds * sample_rate / period);
+  const auto begin = bench_clock::now();
+  for (std::size_t i = 0; i < periods; ++i) {
+    mixer.mix(planes, period);
+    keep(left[0]);
+  }
+  const auto elapsed = to_seconds(bench_clock::now() - begin);
+  return static_cast<double>(periods * period) / sample_rate / elapsed;
+}
+
+// Largest track count that still mixes at least as fast as real time.
+std::size_t realtime_tracks(const char *kernel,
+                            const std::vector<float> &signal,
+                            double seconds) {
+  std::size_t low = 0;
+  std::size_t high = 1;
+  while (realtime_factor(kernel, high, signal, seconds) >= 1.0) {
+    low = high;
+    high *= 2;
+  }
+  // low keeps up, high does not.
+  while (high - low > std::max<std::size_t>(low / 100, 1)) {
+    const auto mid = low + (high - low) / 2;
+    if (realtime_factor(kernel, mid, signal, seconds) >= 1.0) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+int run(std::span<char *const> args) {
+  const double seconds = args.empty() ? 1.0 : std::atof(args[0]);
+  pin_to_one_core();
+
+  std::vector<float> signal(sample_rate);
+  for (std::size_t i = 0; i < signal.size(); ++i) {
+    signal[i] = 0.25F * std::sin(2.0F * std::numbers::pi_v<float> * 440.0F *
+                                 static_cast<float>(i) / sample_rate);
+  }
+
+  fmt::print("stereo tracks mixed in real time at {} Hz on one core "
+             "(default kernel: {})\n",
+             sample_rate, audio_mixer::kernel_name());
+  fmt::print("{:<8} {:>8} {:>14}\n", "kernel", "tracks", "8 tracks, x rt");
+  for (const auto *kernel : audio_mixer::kernel_names()) {
+    const auto tracks = realtime_tracks(kernel, signal, seconds);
+    fmt::print("{:<8} {:>8} {:>14.1f}\n", kernel, tracks,
+               realtime_factor(kernel, 8, signal, seconds));
+  }
+  return 0;
+}
+
+const registrar mixer_bench{"mixer", "[seconds of audio per trial = 1]", run};
+} // namespace
+} // namespace libved::bench
@@ -0,0 +1,88 @@
+#include "bench.hpp"
+#include <errors.hpp>
+#include <exception>
+#include <fmt/core.h>
+#include <map>
+#include <numeric>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+
+namespace libved::bench {
+namespace {
+struct entry {
+  std::string usage;
+  bench_function run;
+};
+
+std::map<std::string, entry, std::less<>> &registry() {
+  static std::map<std::string, entry, std::less<>> benchmarks;
+  return benchmarks;
+}
+
+void print_usage(const char *program) {
+  fmt::print("usage: {} <benchmark> [args...]\n\n", program);
+  for (const auto &[name, e] : registry()) {
+    fmt::print("  {} {}\n", name, e.usage);
+  }
+}
+} // namespace
+
+registrar::registrar(std::string_view name, std::string_view usage,
+                     bench_function run) {
+  registry().emplace(std::string{name}, entry{std::string{usage}, run});
+}
+
+void pin_to_one_core() {
+  const int cpu = sched_getcpu();
+  if (cpu < 0) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+}
+
+latency_summary summarize(std::vector<bench_clock::duration> samples) {
+  if (samples.empty()) {
+    return {};
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto at = [&](double quantile) {
+    const auto index = static_cast<std::size_t>(
+        quantile * static_cast<double>(samples.size() - 1));
+    return samples[index];
+  };
+  const auto total = std::accumulate(samples.begin(), samples.end(),
+                                     bench_clock::duration{});
+  return {
+      .p50 = at(0.5),
+      .p99 = at(0.99),
+      .max = samples.back(),
+      .mean = total / static_cast<std::ptrdiff_t>(samples.size()),
+  };
+}
+} // namespace libved::bench
+
+int main(int argc, char *argv[]) {
+  using namespace libved::bench;
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  auto it = registry().find(std::string_view{argv[1]});
+  if (it == registry().end()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  // Progress logging would interleave with the result tables.
+  spdlog::set_level(spdlog::level::warn);
+  try {
+    return it->second.run(std::span{argv + 2, argv + argc});
+  } catch (std::exception &ex) {
+    libved::log_exception(ex);
+    return 1;
+  }
+}
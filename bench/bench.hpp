@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace libved::bench {
+using bench_clock = std::chrono::steady_clock;
+
+// A benchmark gets the arguments that follow its name and returns the exit
+// code of the run.
+using bench_function = int (*)(std::span<char *const> args);
+
+// Registers a benchmark from a namespace-scope constant of its own file.
+class registrar {
+public:
+  registrar(std::string_view name, std::string_view usage,
+            bench_function run);
+};
+
+// Keeps the calling thread on the CPU it is running on, so that results are
+// per core and not spread over whatever the scheduler picks.
+void pin_to_one_core();
+
+// Stops the compiler from optimising away a result.
+template <typename T> void keep(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+[[nodiscard]] inline double to_seconds(bench_clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+struct latency_summary {
+  bench_clock::duration p50{};
+  bench_clock::duration p99{};
+  bench_clock::duration max{};
+  bench_clock::duration mean{};
+};
+
+[[nodiscard]] latency_summary
+summarize(std::vector<bench_clock::duration> samples);
+
+[[nodiscard]] inline double to_milliseconds(bench_clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+} // namespace libved::bench
@@ -0,0 +1,121 @@
+#include "bench.hpp"
+#include <cstdlib>
+#include <ffmpeg/demuxer.hpp>
+#include <ffmpeg/wrappers/avformat.hpp>
+#include <fmt/core.h>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace libved::bench {
+namespace {
+struct demux_result {
+  std::size_t packets = 0;
+  double packets_per_second = 0;
+  // Longest a consumer waited for its next packet.
+  bench_clock::duration worst_wait{};
+};
+
+// Stands in for decoding: spins for `work` per packet.
+void consume(bench_clock::duration work) {
+  const auto until = bench_clock::now() + work;
+  while (bench_clock::now() < until) {
+  }
+}
+
+// Reading and consuming on the same thread, as before the demuxer thread.
+demux_result inline_loop(const char *path, bench_clock::duration work) {
+  ffmpeg::format_context format_ctx{path};
+  demux_result result;
+  const auto begin = bench_clock::now();
+  auto waited_since = begin;
+  for (auto &&[pkt, guard] : format_ctx.read_frames()) {
+    result.worst_wait =
+        std::max(result.worst_wait, bench_clock::now() - waited_since);
+    keep((*pkt)->size);
+    consume(work);
+    ++result.packets;
+    waited_since = bench_clock::now();
+  }
+  const auto elapsed = to_seconds(bench_clock::now() - begin);
+  result.packets_per_second = static_cast<double>(result.packets) / elapsed;
+  return result;
+}
+
+// The demuxer reads on its own thread; every stream has a consumer thread.
+demux_result threaded(const char *path, bench_clock::duration work) {
+  ffmpeg::format_context format_ctx{path};
+  ffmpeg::demuxer demuxer{format_ctx};
+  const auto streams = format_ctx.streams().size();
+  for (std::size_t i = 0; i < streams; ++i) {
+    demuxer.open_stream(i);
+  }
+
+  std::vector<demux_result> results(streams);
+  const auto begin = bench_clock::now();
+  demuxer.start();
+  {
+    std::vector<std::jthread> consumers;
+    for (std::size_t i = 0; i < streams; ++i) {
+      consumers.emplace_back([&, i] {
+        auto &queue = demuxer.queue(i);
+        auto pkt = ffmpeg::alloc_packet();
+        auto &r = results[i];
+        auto waited_since = bench_clock::now();
+        while (queue.pop(pkt) == ffmpeg::queue_result::success) {
+          r.worst_wait =
+              std::max(r.worst_wait, bench_clock::now() - waited_since);
+          keep(pkt->size);
+          av_packet_unref(pkt.get());
+          consume(work);
+          ++r.packets;
+          waited_since = bench_clock::now();
+        }
+      });
+    }
+  }
+  const auto elapsed = to_seconds(bench_clock::now() - begin);
+
+  demux_result total;
+  for (const auto &r : results) {
+    total.packets += r.packets;
+    total.worst_wait = std::max(total.worst_wait, r.worst_wait);
+  }
+  total.packets_per_second = static_cast<double>(total.packets) / elapsed;
+  return total;
+}
+
+void print(const char *mode, const demux_result &r, const char *path) {
+  fmt::print("{:<9} {:>9} {:>12.0f} {:>14.3f}  {}\n", mode, r.packets,
+             r.packets_per_second, to_milliseconds(r.worst_wait), path);
+}
+
+int run(std::span<char *const> args) {
+  bench_clock::duration work{};
+  std::vector<const char *> files;
+  for (const auto *arg : args) {
+    constexpr std::string_view work_flag = "--work-us=";
+    if (std::string_view{arg}.starts_with(work_flag)) {
+      work = std::chrono::microseconds{std::atoi(arg + work_flag.size())};
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) {
+    fmt::print("demux needs at least one media file\n");
+    return 1;
+  }
+
+  fmt::print("{:<9} {:>9} {:>12} {:>14}  {}\n", "mode", "packets",
+             "packets/s", "worst wait ms", "file");
+  for (const auto *path : files) {
+    print("inline", inline_loop(path, work), path);
+    print("threaded", threaded(path, work), path);
+  }
+  return 0;
+}
+
+const registrar demux_bench{
+    "demux", "[--work-us=<per-packet consumer work>] <media file>...", run};
+} // namespace
+} // namespace libved::bench
@@ -0,0 +1,78 @@
+#include "bench.hpp"
+#include <cstdlib>
+#include <errors.hpp>
+#include <ffmpeg/wrappers/common.hpp>
+#include <fmt/core.h>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+namespace libved::bench {
+namespace {
+// Stands in for a libav* call: fails with EAGAIN once every `every` calls,
+// as receive_frame does while the decoder wants more input.
+[[gnu::noinline]] int libav_call(std::size_t i, std::size_t every) {
+  return every != 0 && i % every == 0 ? AVERROR(EAGAIN) : 0;
+}
+
+// The non-throwing path that the try_* wrappers take.
+double expected_ns(std::size_t calls, std::size_t every) {
+  std::size_t failures = 0;
+  const auto begin = bench_clock::now();
+  for (std::size_t i = 0; i < calls; ++i) {
+    const auto result = ffmpeg::to_expected(libav_call(i, every));
+    if (!result.has_value() && result.error() == AVERROR(EAGAIN)) {
+      ++failures;
+    }
+  }
+  const auto elapsed = bench_clock::now() - begin;
+  keep(failures);
+  return to_seconds(elapsed) * 1e9 / static_cast<double>(calls);
+}
+
+// The throwing path: a nested exception per failure, caught by the caller.
+double exception_ns(std::size_t calls, std::size_t every) {
+  std::size_t failures = 0;
+  const auto begin = bench_clock::now();
+  for (std::size_t i = 0; i < calls; ++i) {
+    try {
+      ffmpeg::call_and_handle_error(
+          throw_nested_runtime_error("Failed to receive frame"), libav_call,
+          i, every);
+    } catch (std::runtime_error &) {
+      ++failures;
+    }
+  }
+  const auto elapsed = bench_clock::now() - begin;
+  keep(failures);
+  return to_seconds(elapsed) * 1e9 / static_cast<double>(calls);
+}
+
+// Cost per call of reporting a failure through av_expected against throwing,
+// for failure rates from never to every call.
+int run(std::span<char *const> args) {
+  const std::size_t calls =
+      args.empty() ? 1'000'000 : std::strtoull(args[0], nullptr, 10);
+  if (calls == 0) {
+    fmt::print("errors needs a positive number of calls\n");
+    return 1;
+  }
+  pin_to_one_core();
+
+  fmt::print("{:<10} {:>13} {:>14} {:>9}\n", "failures", "expected ns",
+             "exception ns", "ratio");
+  for (const std::size_t every : {0, 1000, 100, 10, 2, 1}) {
+    const auto expected = expected_ns(calls, every);
+    const auto exception = exception_ns(calls, every);
+    fmt::print("{:<10} {:>13.2f} {:>14.2f} {:>8.1f}x\n",
+               every == 0 ? std::string{"none"} : fmt::format("1/{}", every),
+               expected, exception, exception / expected);
+  }
+  return 0;
+}
+
+const registrar errors_bench{"errors", "[calls = 1000000]", run};
+} // namespace
+} // namespace libved::bench
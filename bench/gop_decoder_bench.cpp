@@ -0,0 +1,83 @@
+#include "bench.hpp"
+#include "media.hpp"
+#include <cstdlib>
+#include <ffmpeg/gop_decoder.hpp>
+#include <ffmpeg/seek_index.hpp>
+#include <ffmpeg/seekable_decoder.hpp>
+#include <fmt/core.h>
+#include <thread>
+
+namespace libved::bench {
+namespace {
+struct decode_result {
+  std::size_t frames = 0;
+  double frames_per_second = 0;
+};
+
+template <typename Decoder> decode_result read_all(Decoder &decoder) {
+  decode_result result;
+  auto frm = ffmpeg::alloc_frame();
+  const auto begin = bench_clock::now();
+  while (decoder.read_frame(frm)) {
+    av_frame_unref(frm.get());
+    ++result.frames;
+  }
+  result.frames_per_second = static_cast<double>(result.frames) /
+                             to_seconds(bench_clock::now() - begin);
+  return result;
+}
+
+// The reference: one decoder, threaded by FFmpeg itself.
+decode_result decode_sequential(const char *path) {
+  ffmpeg::format_context format_ctx{path};
+  const auto stream_index = video_stream(format_ctx, path);
+  ffmpeg::codec_context codec_ctx{*format_ctx.streams()[stream_index]};
+  codec_ctx.set_threading({});
+  codec_ctx.init();
+  ffmpeg::seekable_decoder decoder{format_ctx, codec_ctx, stream_index};
+  return read_all(decoder);
+}
+
+decode_result decode_gops(const char *path, const ffmpeg::seek_index &index,
+                          std::size_t workers) {
+  ffmpeg::gop_decoder decoder{path, index, {.workers = workers}};
+  return read_all(decoder);
+}
+
+// Export decoding throughput as the number of GOP workers grows, against a
+// single frame-threaded decoder.
+int run(std::span<char *const> args) {
+  if (args.empty()) {
+    fmt::print("gop needs a video file\n");
+    return 1;
+  }
+  const auto *path = args[0];
+  const std::size_t max_workers =
+      args.size() > 1 ? std::atoi(args[1])
+                      : std::max(std::thread::hardware_concurrency(), 1U);
+  const auto index = ffmpeg::seek_index::build(path);
+
+  const auto reference = decode_sequential(path);
+  fmt::print("{:<12} {:>8} {:>10} {:>9}\n", "decoder", "frames", "frames/s",
+             "speedup");
+  fmt::print("{:<12} {:>8} {:>10.1f} {:>9}\n", "ffmpeg auto",
+             reference.frames, reference.frames_per_second, "-");
+
+  double single = 0;
+  for (std::size_t workers = 1; workers <= max_workers;
+       workers = workers < max_workers ? std::min(workers * 2, max_workers)
+                                       : workers + 1) {
+    const auto result = decode_gops(path, index, workers);
+    if (workers == 1) {
+      single = result.frames_per_second;
+    }
+    fmt::print("{:<12} {:>8} {:>10.1f} {:>8.2f}x\n",
+               fmt::format("gop x{}", workers), result.frames,
+               result.frames_per_second, result.frames_per_second / single);
+  }
+  return 0;
+}
+
+const registrar gop_bench{"gop", "<video file> [max workers = cpus]", run};
+} // namespace
+} // namespace libved::bench
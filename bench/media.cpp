@@ -0,0 +1,47 @@
+#include "media.hpp"
+#include <fmt/core.h>
+#include <random>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+namespace libved::bench {
+std::size_t video_stream(const ffmpeg::format_context &format_ctx,
+                         const char *path) {
+  const auto [index, _] = format_ctx.find_stream(AVMEDIA_TYPE_VIDEO);
+  if (index == ffmpeg::format_context::npos) {
+    throw std::runtime_error{fmt::format("No video stream in '{}'", path)};
+  }
+  return index;
+}
+
+std::vector<std::int64_t>
+random_positions(const ffmpeg::format_context &format_ctx,
+                 std::size_t stream_index, std::size_t count, unsigned seed) {
+  const auto &st = *format_ctx.streams()[stream_index];
+  const auto start = st.start_time != AV_NOPTS_VALUE ? st.start_time : 0;
+  auto duration = st.duration;
+  if (duration == AV_NOPTS_VALUE || duration <= 0) {
+    duration = av_rescale_q(format_ctx->duration, AVRational{1, AV_TIME_BASE},
+                            st.time_base);
+  }
+  if (duration <= 0) {
+    throw std::runtime_error{"Stream has no known duration to seek in"};
+  }
+
+  std::mt19937_64 engine{seed};
+  std::uniform_int_distribution<std::int64_t> position{start,
+                                                       start + duration - 1};
+  std::vector<std::int64_t> positions(count);
+  for (auto &p : positions) {
+    p = position(engine);
+  }
+  return positions;
+}
+
+const char *codec_name(const AVStream &st) {
+  return avcodec_get_name(st.codecpar->codec_id);
+}
+} // namespace libved::bench
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ffmpeg/wrappers/avformat.hpp>
+#include <vector>
+
+namespace libved::bench {
+// Index of the video stream of `format_ctx`; throws if there is none.
+[[nodiscard]] std::size_t video_stream(const ffmpeg::format_context &format_ctx,
+                                       const char *path);
+
+// `count` timestamps spread at random over a stream, in its time base. The
+// same seed gives the same positions, so runs can be compared.
+[[nodiscard]] std::vector<std::int64_t>
+random_positions(const ffmpeg::format_context &format_ctx,
+                 std::size_t stream_index, std::size_t count,
+                 unsigned seed = 1);
+
+[[nodiscard]] const char *codec_name(const AVStream &st);
+} // namespace libved::bench
@@ -0,0 +1,77 @@
+#include "bench.hpp"
+#include <cstdlib>
+#include <ffmpeg/pbo_readback.hpp>
+#include <fmt/core.h>
+#include <headless_display.hpp>
+#include <string_view>
+
+namespace libved::bench {
+namespace {
+struct readback_case {
+  const char *name;
+  extent2d size;
+  vaapi::readback_format format;
+};
+
+struct readback_result {
+  double frames_per_second;
+  vaapi::readback_stats stats;
+};
+
+// Renders `frames` frames offscreen, reads each of them back and touches
+// every row of it on the consumer side, as an encoder would.
+readback_result run_case(const readback_case &c, std::size_t frames) {
+  headless::offscreen display{display_params{.size = c.size}};
+  std::uint64_t checksum = 0;
+  vaapi::pbo_readback readback{
+      static_cast<int>(c.size.width), static_cast<int>(c.size.height),
+      [&](vaapi::readback_frame frame) {
+        const auto plane = frame.plane(0);
+        for (std::size_t i = 0; i < plane.size(); i += frame.stride(0)) {
+          checksum += plane[i];
+        }
+      },
+      {.format = c.format}};
+
+  const auto begin = bench_clock::now();
+  for (std::size_t i = 0; i < frames; ++i) {
+    {
+      auto frame = display.new_frame();
+      const auto shade = static_cast<float>(i % 256) / 255.0F;
+      glClearColor(shade, 1.0F - shade, 0.5F, 1.0F);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+    readback.capture(display.framebuffer());
+  }
+  readback.flush();
+  const auto elapsed = to_seconds(bench_clock::now() - begin);
+  keep(checksum);
+  return {static_cast<double>(frames) / elapsed, readback.stats()};
+}
+
+int run(std::span<char *const> args) {
+  const std::size_t frames = args.empty() ? 300 : std::atoi(args[0]);
+  using enum vaapi::readback_format;
+  const readback_case cases[] = {
+      {"1080p", {1920, 1080}, rgba},
+      {"1080p", {1920, 1080}, nv12},
+      {"4k", {3840, 2160}, rgba},
+      {"4k", {3840, 2160}, nv12},
+  };
+
+  fmt::print("{:<6} {:<5} {:>10} {:>10} {:>8}\n", "size", "fmt", "frames/s",
+             "delivered", "stalls");
+  for (const auto &c : cases) {
+    const auto result = run_case(c, frames);
+    fmt::print("{:<6} {:<5} {:>10.1f} {:>10} {:>8}\n", c.name,
+               c.format == rgba ? "rgba" : "nv12", result.frames_per_second,
+               result.stats.delivered, result.stats.stalls);
+  }
+  return 0;
+}
+
+const registrar readback_bench{
+    "readback", "[frames per case = 300] (run from the source directory)",
+    run};
+} // namespace
+} // namespace libved::bench
@@ -0,0 +1,86 @@
+#include "bench.hpp"
+#include "media.hpp"
+#include <fmt/core.h>
+#include <utility>
+
+namespace libved::bench {
+namespace {
+struct preview_result {
+  std::size_t packets = 0;
+  std::size_t frames = 0;
+  double seconds = 0;
+};
+
+std::size_t receive_all(ffmpeg::codec_context &codec_ctx,
+                        const ffmpeg::frame &frm) {
+  std::size_t frames = 0;
+  while (codec_ctx.receive_frame(frm) == ffmpeg::send_receive_result::success) {
+    av_frame_unref(frm.get());
+    ++frames;
+  }
+  return frames;
+}
+
+preview_result decode(const char *path, ffmpeg::preview_mode mode) {
+  ffmpeg::format_context format_ctx{path};
+  const auto stream_index = video_stream(format_ctx, path);
+  ffmpeg::codec_context codec_ctx{*format_ctx.streams()[stream_index]};
+  codec_ctx.set_preview_mode(mode);
+  codec_ctx.init();
+
+  preview_result result;
+  auto frm = ffmpeg::alloc_frame();
+  const auto begin = bench_clock::now();
+  for (auto &&[pkt, guard] : format_ctx.read_frames()) {
+    if (static_cast<std::size_t>((*pkt)->stream_index) != stream_index) {
+      continue;
+    }
+    codec_ctx.send_packet(*pkt);
+    ++result.packets;
+    result.frames += receive_all(codec_ctx, frm);
+  }
+  codec_ctx.send_packet(nullptr);
+  result.frames += receive_all(codec_ctx, frm);
+  result.seconds = to_seconds(bench_clock::now() - begin);
+  return result;
+}
+
+// Decoding speed of each preview mode. Modes that skip frames output fewer
+// of them, so the speed that matters for playback is how fast the decoder
+// gets through the stream: its packets per second.
+int run(std::span<char *const> args) {
+  if (args.empty()) {
+    fmt::print("preview needs at least one video file\n");
+    return 1;
+  }
+
+  using enum ffmpeg::preview_mode;
+  const std::pair<ffmpeg::preview_mode, const char *> modes[] = {
+      {full, "full"},
+      {fast, "fast"},
+      {no_b_frames, "no_b_frames"},
+      {keyframes_only, "keyframes_only"},
+  };
+  fmt::print("{:<8} {:<15} {:>10} {:>10} {:>9}  {}\n", "codec", "mode",
+             "frames/s", "packets/s", "frames", "file");
+  for (const auto *path : args) {
+    const char *codec = nullptr;
+    {
+      ffmpeg::format_context format_ctx{path};
+      codec = codec_name(
+          *format_ctx.streams()[video_stream(format_ctx, path)]);
+    }
+    for (const auto &[mode, name] : modes) {
+      const auto r = decode(path, mode);
+      fmt::print("{:<8} {:<15} {:>10.1f} {:>10.1f} {:>9}  {}\n", codec, name,
+                 static_cast<double>(r.frames) / r.seconds,
+                 static_cast<double>(r.packets) / r.seconds, r.frames, path);
+    }
+  }
+  return 0;
+}
+
+const registrar preview_bench{
+    "preview", "<video file>... (e.g. one each of H.264, HEVC and VP9)", run};
+} // namespace
+} // namespace libved::bench
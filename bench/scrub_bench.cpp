@@ -0,0 +1,50 @@
+#include "bench.hpp"
+#include "media.hpp"
+#include <ffmpeg/seekable_decoder.hpp>
+#include <fmt/core.h>
+
+namespace libved::bench {
+namespace {
+constexpr std::size_t seeks_per_file = 200;
+
+// Scrubbing: frame-accurate seeks to random positions, each timed until the
+// exact frame is decoded. One file per codec to compare.
+int run(std::span<char *const> args) {
+  if (args.empty()) {
+    fmt::print("scrub needs at least one video file\n");
+    return 1;
+  }
+
+  fmt::print("{:<12} {:>6} {:>9} {:>9} {:>9}  {}\n", "codec", "seeks",
+             "p50 ms", "p99 ms", "max ms", "file");
+  for (const auto *path : args) {
+    ffmpeg::format_context format_ctx{path};
+    const auto stream_index = video_stream(format_ctx, path);
+    const auto &st = *format_ctx.streams()[stream_index];
+    ffmpeg::codec_context codec_ctx{st};
+    codec_ctx.init();
+    ffmpeg::seekable_decoder decoder{format_ctx, codec_ctx, stream_index};
+
+    auto frm = ffmpeg::alloc_frame();
+    std::vector<bench_clock::duration> latencies;
+    for (const auto pts :
+         random_positions(format_ctx, stream_index, seeks_per_file)) {
+      const auto begin = bench_clock::now();
+      if (decoder.seek_to(pts, frm)) {
+        latencies.push_back(bench_clock::now() - begin);
+      }
+      av_frame_unref(frm.get());
+    }
+
+    const auto summary = summarize(latencies);
+    fmt::print("{:<12} {:>6} {:>9.2f} {:>9.2f} {:>9.2f}  {}\n",
+               codec_name(st), latencies.size(),
+               to_milliseconds(summary.p50), to_milliseconds(summary.p99),
+               to_milliseconds(summary.max), path);
+  }
+  return 0;
+}
+
+const registrar scrub_bench{"scrub", "<video file>... (one per codec)", run};
+} // namespace
+} // namespace libved::bench
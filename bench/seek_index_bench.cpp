@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include "media.hpp"
+#include <ffmpeg/seek_index.hpp>
+#include <fmt/core.h>
+#include <string>
+
+namespace libved::bench {
+namespace {
+constexpr std::size_t seeks_per_file = 200;
+
+// Time to position the input and read the first packet of the stream after
+// it, which is where a seek's cost shows in demuxers that seek lazily.
+bench_clock::duration timed_seek(ffmpeg::format_context &format_ctx,
+                                 std::size_t stream_index, std::int64_t pts,
+                                 const ffmpeg::seek_index *index,
+                                 ffmpeg::packet &pkt) {
+  const auto begin = bench_clock::now();
+  if (index == nullptr || !index->seek(format_ctx, pts).has_value()) {
+    format_ctx.seek(stream_index, pts, AVSEEK_FLAG_BACKWARD);
+  }
+  while (format_ctx.try_read_frame(pkt.get()).has_value()) {
+    const bool found =
+        static_cast<std::size_t>(pkt->stream_index) == stream_index;
+    av_packet_unref(pkt.get());
+    if (found) {
+      break;
+    }
+  }
+  return bench_clock::now() - begin;
+}
+
+int run(std::span<char *const> args) {
+  if (args.empty()) {
+    fmt::print("seek needs at least one video file\n");
+    return 1;
+  }
+
+  fmt::print("{:<10} {:<6} {:>9} {:>9} {:>9}  {}\n", "container", "index",
+             "p50 ms", "p99 ms", "build ms", "file");
+  for (const auto *path : args) {
+    ffmpeg::format_context format_ctx{path};
+    const auto stream_index = video_stream(format_ctx, path);
+    const auto positions =
+        random_positions(format_ctx, stream_index, seeks_per_file);
+
+    const auto build_begin = bench_clock::now();
+    const auto index = ffmpeg::seek_index::build(path, stream_index);
+    const auto build_time = bench_clock::now() - build_begin;
+
+    auto pkt = ffmpeg::alloc_packet();
+    for (const auto *used : {static_cast<const ffmpeg::seek_index *>(nullptr),
+                             &index}) {
+      std::vector<bench_clock::duration> latencies;
+      for (const auto pts : positions) {
+        latencies.push_back(
+            timed_seek(format_ctx, stream_index, pts, used, pkt));
+      }
+      const auto summary = summarize(latencies);
+      fmt::print("{:<10} {:<6} {:>9.3f} {:>9.3f} {:>9}  {}\n",
+                 format_ctx->iformat->name, used != nullptr ? "yes" : "no",
+                 to_milliseconds(summary.p50), to_milliseconds(summary.p99),
+                 used != nullptr
+                     ? fmt::format("{:.1f}", to_milliseconds(build_time))
+                     : std::string{"-"},
+                 path);
+    }
+  }
+  return 0;
+}
+
+const registrar seek_bench{"seek", "<video file>... (one per container)",
+                           run};
+} // namespace
+} // namespace libved::bench
@@ -0,0 +1,72 @@
+#include "bench.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <ffmpeg/thumbnailer.hpp>
+#include <filesystem>
+#include <fmt/core.h>
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace libved::bench {
+namespace {
+// Filmstrips for every file at once, as the media bin requests them.
+double thumbnails_per_second(ffmpeg::thumbnailer &thumbnailer,
+                             const std::vector<const char *> &files,
+                             std::size_t count) {
+  const auto begin = bench_clock::now();
+  std::vector<std::future<std::vector<ffmpeg::thumbnail>>> strips;
+  for (const auto *path : files) {
+    strips.push_back(thumbnailer.filmstrip(path, count));
+  }
+  std::size_t thumbnails = 0;
+  for (auto &strip : strips) {
+    thumbnails += strip.get().size();
+  }
+  return static_cast<double>(thumbnails) /
+         to_seconds(bench_clock::now() - begin);
+}
+
+// Generation runs against an empty cache in a directory of its own, then the
+// same requests are repeated to measure cache hits.
+int run(std::span<char *const> args) {
+  std::size_t count = 20;
+  std::vector<const char *> files;
+  for (const auto *arg : args) {
+    constexpr std::string_view count_flag = "--count=";
+    if (std::string_view{arg}.starts_with(count_flag)) {
+      count = std::atoi(arg + count_flag.size());
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) {
+    fmt::print("thumbs needs at least one video file\n");
+    return 1;
+  }
+
+  const auto directory =
+      std::filesystem::temp_directory_path() /
+      fmt::format("libved-thumbs-bench-{}",
+                  bench_clock::now().time_since_epoch().count());
+  double generated = 0;
+  double cached = 0;
+  {
+    ffmpeg::thumbnailer thumbnailer{
+        {}, 0, std::make_shared<const ffmpeg::thumbnail_cache>(directory)};
+    generated = thumbnails_per_second(thumbnailer, files, count);
+    cached = thumbnails_per_second(thumbnailer, files, count);
+  }
+  std::filesystem::remove_all(directory);
+
+  fmt::print("{:<10} {:>14}\n", "cache", "thumbnails/s");
+  fmt::print("{:<10} {:>14.1f}\n", "empty", generated);
+  fmt::print("{:<10} {:>14.1f}\n", "warm", cached);
+  return 0;
+}
+
+const registrar thumbs_bench{
+    "thumbs", "[--count=<thumbnails per file = 20>] <video file>...", run};
+} // namespace
+} // namespace libved::bench
@@ -0,0 +1,275 @@
+#include "audio_mixer.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fmt/core.h>
+#include <numbers>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBVED_MIXER_AVX2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LIBVED_MIXER_NEON
+#endif
+
+namespace libved {
+namespace {
+// Planes start on cache lines, enough for any vector width.
+constexpr std::size_t mix_alignment = 64;
+
+// out[i] += in[i] * (gain + i * step)
+using mix_kernel = void (*)(float *out, const float *in, std::size_t n,
+                            float gain, float step);
+
+void mix_ramp_scalar(float *out, const float *in, std::size_t n, float gain,
+                     float step) {
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] += in[i] * (gain + static_cast<float>(i) * step);
+  }
+}
+
+#ifdef LIBVED_MIXER_AVX2
+__attribute__((target("avx2,fma"))) void
+mix_ramp_avx2(float *out, const float *in, std::size_t n, float gain,
+              float step) {
+  // Gains are computed from the sample index rather than accumulated, so
+  // long ramps do not pick up rounding error.
+  auto index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const auto index_step = _mm256_set1_ps(8);
+  const auto gain_v = _mm256_set1_ps(gain);
+  const auto step_v = _mm256_set1_ps(step);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto g = _mm256_fmadd_ps(index, step_v, gain_v);
+    const auto mixed =
+        _mm256_fmadd_ps(_mm256_loadu_ps(in + i), g, _mm256_loadu_ps(out + i));
+    _mm256_storeu_ps(out + i, mixed);
+    index = _mm256_add_ps(index, index_step);
+  }
+  mix_ramp_scalar(out + i, in + i, n - i,
+                  gain + static_cast<float>(i) * step, step);
+}
+#endif
+
+#ifdef LIBVED_MIXER_NEON
+void mix_ramp_neon(float *out, const float *in, std::size_t n, float gain,
+                   float step) {
+  const float lanes[] = {0, 1, 2, 3};
+  auto index = vld1q_f32(lanes);
+  const auto index_step = vdupq_n_f32(4);
+  const auto gain_v = vdupq_n_f32(gain);
+  const auto step_v = vdupq_n_f32(step);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto g = vmlaq_f32(gain_v, index, step_v);
+    vst1q_f32(out + i, vmlaq_f32(vld1q_f32(out + i), vld1q_f32(in + i), g));
+    index = vaddq_f32(index, index_step);
+  }
+  mix_ramp_scalar(out + i, in + i, n - i,
+                  gain + static_cast<float>(i) * step, step);
+}
+#endif
+
+struct kernel_choice {
+  mix_kernel kernel;
+  const char *name;
+};
+
+// Every kernel this CPU can run, fastest first.
+std::vector<kernel_choice> supported_kernels() {
+  std::vector<kernel_choice> kernels;
+#ifdef LIBVED_MIXER_AVX2
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    kernels.push_back({mix_ramp_avx2, "avx2"});
+  }
+#endif
+#ifdef LIBVED_MIXER_NEON
+  kernels.push_back({mix_ramp_neon, "neon"});
+#endif
+  kernels.push_back({mix_ramp_scalar, "scalar"});
+  return kernels;
+}
+
+const std::vector<kernel_choice> &kernels() {
+  static const auto supported = supported_kernels();
+  return supported;
+}
+
+const kernel_choice &find_kernel(const char *name) {
+  if (name == nullptr) {
+    return kernels().front();
+  }
+  const auto &supported = kernels();
+  auto it = std::find_if(supported.begin(), supported.end(),
+                         [&](const kernel_choice &k) {
+                           return std::string_view{k.name} == name;
+                         });
+  if (it == supported.end()) {
+    throw std::invalid_argument{
+        fmt::format("Mixer kernel '{}' is not supported here", name)};
+  }
+  return *it;
+}
+
+// Left and right gains of a track at `gain` and `pan`.
+std::array<float, 2> channel_gains(float gain, float pan, int channels) {
+  pan = std::clamp(pan, -1.0F, 1.0F);
+  if (channels == 1) {
+    // Constant power, normalised to unity when centred.
+    const auto angle = (pan + 1.0F) * std::numbers::pi_v<float> / 4.0F;
+    return {gain * std::numbers::sqrt2_v<float> * std::cos(angle),
+            gain * std::numbers::sqrt2_v<float> * std::sin(angle)};
+  }
+  return {gain * std::min(1.0F, 1.0F - pan), gain * std::min(1.0F, 1.0F + pan)};
+}
+
+// Automation at `sample`, given that `next` is the first point after it.
+std::array<float, 2> automation_at(std::span<const automation_point> points,
+                                   std::size_t next, std::int64_t sample,
+                                   int channels) {
+  if (points.empty()) {
+    return channel_gains(1.0F, 0.0F, channels);
+  }
+  if (next == 0 || next == points.size()) {
+    const auto &p = points[next == 0 ? 0 : next - 1];
+    return channel_gains(p.gain, p.pan, channels);
+  }
+
+  const auto &from = points[next - 1];
+  const auto &to = points[next];
+  const auto t = static_cast<float>(sample - from.sample) /
+                 static_cast<float>(to.sample - from.sample);
+  return channel_gains(std::lerp(from.gain, to.gain, t),
+                       std::lerp(from.pan, to.pan, t), channels);
+}
+} // namespace
+
+void audio_mixer::aligned_delete::operator()(float *p) const {
+  ::operator delete[](p, std::align_val_t{mix_alignment});
+}
+
+audio_mixer::audio_mixer(audio_mixer_params params)
+    : m_params{params}, m_kernel{find_kernel(params.kernel).kernel} {
+  // Keep every plane of a track buffer aligned.
+  constexpr auto floats_per_line = mix_alignment / sizeof(float);
+  m_params.block_samples =
+      std::max<std::size_t>(
+          (m_params.block_samples + floats_per_line - 1) / floats_per_line,
+          1) *
+      floats_per_line;
+}
+
+const char *audio_mixer::kernel_name() { return kernels().front().name; }
+
+std::vector<const char *> audio_mixer::kernel_names() {
+  std::vector<const char *> names;
+  for (const auto &k : kernels()) {
+    names.push_back(k.name);
+  }
+  return names;
+}
+
+audio_mixer::track_id audio_mixer::add_track(audio_source source,
+                                             int channels) {
+  if (channels != 1 && channels != 2) {
+    throw std::invalid_argument{"audio_mixer tracks are mono or stereo"};
+  }
+
+  track t{
+      .source = std::move(source),
+      .channels = channels,
+      .buffer = std::unique_ptr<float, aligned_delete>{static_cast<float *>(
+          ::operator new[](static_cast<std::size_t>(channels) *
+                               m_params.block_samples * sizeof(float),
+                           std::align_val_t{mix_alignment}))},
+  };
+  for (int c = 0; c < channels; ++c) {
+    t.planes.push_back(t.buffer.get() +
+                       static_cast<std::size_t>(c) * m_params.block_samples);
+  }
+  m_tracks.push_back(std::move(t));
+  return m_tracks.size() - 1;
+}
+
+void audio_mixer::set_automation(track_id track,
+                                 std::vector<automation_point> points) {
+  auto &t = m_tracks.at(track);
+  t.automation = std::move(points);
+  t.next_point = 0;
+}
+
+void audio_mixer::mix_track(track &t, std::span<float *const> planes,
+                            std::size_t offset, std::size_t samples) {
+  const auto mix_ramp = m_kernel;
+  const std::span<const automation_point> points = t.automation;
+  std::size_t done = 0;
+  while (done < samples) {
+    const auto at = m_position + static_cast<std::int64_t>(done);
+    while (t.next_point < points.size() && points[t.next_point].sample <= at) {
+      ++t.next_point;
+    }
+
+    // Ramp up to the next automation point or the end of the block.
+    auto end = samples;
+    if (t.next_point < points.size()) {
+      end = std::min(end, static_cast<std::size_t>(
+                              points[t.next_point].sample - m_position));
+    }
+    const auto length = end - done;
+    const auto from = automation_at(points, t.next_point, at, t.channels);
+    const auto to = automation_at(points, t.next_point,
+                                  at + static_cast<std::int64_t>(length),
+                                  t.channels);
+    for (std::size_t c = 0; c < 2; ++c) {
+      const auto *in = t.planes[t.channels == 2 ? c : 0] + done;
+      mix_ramp(planes[c] + offset + done, in, length, from[c],
+               (to[c] - from[c]) / static_cast<float>(length));
+    }
+    done = end;
+  }
+}
+
+std::size_t audio_mixer::mix_block(std::span<float *const> planes,
+                                   std::size_t offset, std::size_t samples) {
+  for (std::size_t c = 0; c < 2; ++c) {
+    std::fill_n(planes[c] + offset, samples, 0.0F);
+  }
+
+  std::size_t mixed = 0;
+  for (auto &t : m_tracks) {
+    if (t.ended) {
+      continue;
+    }
+    const auto read = std::min(t.source(t.planes, samples), samples);
+    if (read < samples) {
+      t.ended = true;
+    }
+    mix_track(t, planes, offset, read);
+    mixed = std::max(mixed, read);
+  }
+  m_position += static_cast<std::int64_t>(mixed);
+  return mixed;
+}
+
+std::size_t audio_mixer::mix(std::span<float *const> planes,
+                             std::size_t samples) {
+  if (planes.size() != 2) {
+    return 0;
+  }
+
+  std::size_t written = 0;
+  while (written < samples) {
+    const auto count = std::min(samples - written, m_params.block_samples);
+    const auto mixed = mix_block(planes, written, count);
+    written += mixed;
+    if (mixed < count) {
+      break;
+    }
+  }
+  return written;
+}
+} // namespace libved
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "audio_output.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+
+namespace libved {
+struct audio_mixer_params {
+  // Samples mixed per pass; mix() calls asking for more are split.
+  std::size_t block_samples = 1024;
+  // One of kernel_names(), to force a kernel; null picks the fastest.
+  const char *kernel = nullptr;
+};
+
+// Gain and pan of a track from `sample` on, counted from the first mixed
+// sample. Between points both ramp linearly.
+struct automation_point {
+  std::int64_t sample = 0;
+  float gain = 1.0F;
+  // -1 is hard left, 1 hard right.
+  float pan = 0.0F;
+};
+
+// Sums any number of planar float tracks, mono or stereo, into one stereo
+// output, applying per-track gain and pan automation with sample-accurate
+// ramps. Mono tracks are panned at constant power, stereo tracks balanced.
+//
+// Tracks and their automation are set up before mixing starts. mix() runs
+// on the audio thread and never allocates: every track reads into buffers
+// of block_samples allocated by add_track().
+class audio_mixer {
+public:
+  using track_id = std::size_t;
+
+  explicit audio_mixer(audio_mixer_params params = {});
+
+  track_id add_track(audio_source source, int channels = 2);
+  // `points` must be sorted by sample. A track without points plays at
+  // unity gain, centred.
+  void set_automation(track_id track, std::vector<automation_point> points);
+
+  // Has the signature of an audio_source for a stereo audio_output. Returns
+  // fewer than `samples` only once every track has ended.
+  std::size_t mix(std::span<float *const> planes, std::size_t samples);
+
+  [[nodiscard]] std::size_t track_count() const noexcept {
+    return m_tracks.size();
+  }
+  // Name of the kernel picked for this CPU, e.g. "avx2".
+  [[nodiscard]] static const char *kernel_name();
+  // Every kernel this CPU can run, fastest first.
+  [[nodiscard]] static std::vector<const char *> kernel_names();
+
+private:
+  struct aligned_delete {
+    void operator()(float *p) const;
+  };
+
+  struct track {
+    audio_source source;
+    int channels;
+    std::unique_ptr<float, aligned_delete> buffer;
+    std::vector<float *> planes;
+    std::vector<automation_point> automation;
+    // First automation point after the mixed position.
+    std::size_t next_point = 0;
+    bool ended = false;
+  };
+
+  std::size_t mix_block(std::span<float *const> planes, std::size_t offset,
+                        std::size_t samples);
+  void mix_track(track &t, std::span<float *const> planes,
+                 std::size_t offset, std::size_t samples);
+
+  using mix_kernel = void (*)(float *out, const float *in, std::size_t n,
+                              float gain, float step);
+
+  audio_mixer_params m_params;
+  mix_kernel m_kernel;
+  std::vector<track> m_tracks;
+  // Samples mixed so far, the time base of automation.
+  std::int64_t m_position = 0;
+};
+} // namespace libved
@@ -0,0 +1,218 @@
+#include "audio_output.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace libved {
+namespace {
+void check_al(const char *what) {
+  if (const auto error = alGetError(); error != AL_NO_ERROR) {
+    throw std::runtime_error{fmt::format("{}: OpenAL error {:#x}", what,
+                                         static_cast<unsigned>(error))};
+  }
+}
+
+std::int16_t to_s16(float sample) {
+  return static_cast<std::int16_t>(
+      std::lrint(std::clamp(sample, -1.0F, 1.0F) * 32767.0F));
+}
+} // namespace
+
+void audio_output::device_deleter::operator()(ALCdevice *d) {
+  alcCloseDevice(d);
+}
+
+void audio_output::context_deleter::operator()(ALCcontext *c) {
+  alcMakeContextCurrent(nullptr);
+  alcDestroyContext(c);
+}
+
+audio_output::audio_output(audio_source source, audio_output_params params)
+    : m_source{std::move(source)}, m_params{params},
+      m_buffers(std::max<std::size_t>(params.buffer_count, 2)) {
+  if (m_params.channels != 1 && m_params.channels != 2) {
+    throw std::invalid_argument{"audio_output supports mono and stereo"};
+  }
+
+  m_device.reset(alcOpenDevice(nullptr));
+  if (m_device == nullptr) {
+    throw std::runtime_error{"Unable to open OpenAL device"};
+  }
+  m_context.reset(alcCreateContext(m_device.get(), nullptr));
+  if (m_context == nullptr || !alcMakeContextCurrent(m_context.get())) {
+    throw std::runtime_error{"Unable to create OpenAL context"};
+  }
+
+  m_float_samples = alIsExtensionPresent("AL_EXT_FLOAT32");
+  if (m_float_samples) {
+    m_format = alGetEnumValue(m_params.channels == 2
+                                  ? "AL_FORMAT_STEREO_FLOAT32"
+                                  : "AL_FORMAT_MONO_FLOAT32");
+  } else {
+    m_format =
+        m_params.channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+  }
+
+  alGenSources(1, &m_al_source);
+  alGenBuffers(static_cast<ALsizei>(m_buffers.size()), m_buffers.data());
+  check_al("Unable to create OpenAL source");
+
+  const auto channels = static_cast<std::size_t>(m_params.channels);
+  m_planar.resize(channels * m_params.buffer_samples);
+  for (std::size_t i = 0; i < channels; ++i) {
+    m_planes.push_back(m_planar.data() + i * m_params.buffer_samples);
+  }
+  m_frame_bytes =
+      channels * (m_float_samples ? sizeof(float) : sizeof(std::int16_t));
+  m_interleaved.resize(m_params.buffer_samples * m_frame_bytes);
+}
+
+audio_output::~audio_output() {
+  stop();
+  alDeleteSources(1, &m_al_source);
+  alDeleteBuffers(static_cast<ALsizei>(m_buffers.size()), m_buffers.data());
+}
+
+bool audio_output::fill(ALuint buffer) {
+  const auto samples = std::min(m_source(m_planes, m_params.buffer_samples),
+                                m_params.buffer_samples);
+  if (samples == 0) {
+    return false;
+  }
+
+  const auto channels = m_planes.size();
+  if (m_float_samples) {
+    auto *out = reinterpret_cast<float *>(m_interleaved.data());
+    for (std::size_t i = 0; i < samples; ++i) {
+      for (std::size_t c = 0; c < channels; ++c) {
+        *out++ = m_planes[c][i];
+      }
+    }
+  } else {
+    auto *out = reinterpret_cast<std::int16_t *>(m_interleaved.data());
+    for (std::size_t i = 0; i < samples; ++i) {
+      for (std::size_t c = 0; c < channels; ++c) {
+        *out++ = to_s16(m_planes[c][i]);
+      }
+    }
+  }
+
+  alBufferData(buffer, m_format, m_interleaved.data(),
+               static_cast<ALsizei>(samples * m_frame_bytes),
+               m_params.sample_rate);
+  alSourceQueueBuffers(m_al_source, 1, &buffer);
+  return true;
+}
+
+void audio_output::run(std::stop_token stop) {
+  // Buffers not on the source, ready to be filled.
+  std::vector<ALuint> free_buffers{m_buffers.rbegin(), m_buffers.rend()};
+  std::vector<ALsizei> buffer_samples(m_buffers.size());
+  const auto buffer_duration = std::chrono::microseconds{
+      static_cast<std::int64_t>(m_params.buffer_samples) * 1'000'000 /
+      m_params.sample_rate};
+  bool primed = false;
+
+  while (!stop.stop_requested()) {
+    ALint processed = 0;
+    alGetSourcei(m_al_source, AL_BUFFERS_PROCESSED, &processed);
+    for (ALint i = 0; i < processed; ++i) {
+      ALuint buffer = 0;
+      ALint size = 0;
+      {
+        std::lock_guard lock{m_position_mutex};
+        alSourceUnqueueBuffers(m_al_source, 1, &buffer);
+        alGetBufferi(buffer, AL_SIZE, &size);
+        m_processed_samples += size / static_cast<ALint>(m_frame_bytes);
+      }
+      m_buffers_played.fetch_add(1, std::memory_order_relaxed);
+      free_buffers.push_back(buffer);
+    }
+
+    while (!free_buffers.empty() && fill(free_buffers.back())) {
+      free_buffers.pop_back();
+    }
+
+    const auto queued = m_buffers.size() - free_buffers.size();
+    m_queued.store(queued, std::memory_order_relaxed);
+    if (primed) {
+      m_min_queued.store(
+          std::min(m_min_queued.load(std::memory_order_relaxed), queued),
+          std::memory_order_relaxed);
+    }
+
+    ALint state = AL_STOPPED;
+    alGetSourcei(m_al_source, AL_SOURCE_STATE, &state);
+    if (!m_paused.load(std::memory_order_relaxed) && state != AL_PLAYING &&
+        queued > 0) {
+      // A source that ran out of buffers stops by itself.
+      if (primed && state == AL_STOPPED) {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+        spdlog::debug("Audio underrun");
+      }
+      if (!primed) {
+        primed = true;
+        m_min_queued.store(queued, std::memory_order_relaxed);
+      }
+      alSourcePlay(m_al_source);
+    }
+
+    std::this_thread::sleep_for(buffer_duration / 4);
+  }
+}
+
+void audio_output::start() {
+  if (m_thread.joinable()) {
+    return;
+  }
+  m_paused.store(false);
+  {
+    std::lock_guard lock{m_position_mutex};
+    m_processed_samples = 0;
+  }
+  m_thread = std::jthread{[this](std::stop_token stop) { run(stop); }};
+}
+
+void audio_output::stop() {
+  if (!m_thread.joinable()) {
+    return;
+  }
+  m_thread.request_stop();
+  m_thread.join();
+  alSourceStop(m_al_source);
+  alSourcei(m_al_source, AL_BUFFER, 0);
+}
+
+void audio_output::set_paused(bool paused) {
+  m_paused.store(paused);
+  if (paused) {
+    alSourcePause(m_al_source);
+  } else {
+    alSourcePlay(m_al_source);
+  }
+}
+
+std::int64_t audio_output::played_samples() const {
+  std::lock_guard lock{m_position_mutex};
+  ALint offset = 0;
+  alGetSourcei(m_al_source, AL_SAMPLE_OFFSET, &offset);
+  return m_processed_samples + offset;
+}
+
+std::chrono::nanoseconds audio_output::position() const {
+  return std::chrono::nanoseconds{played_samples() * 1'000'000'000 /
+                                  m_params.sample_rate};
+}
+
+audio_output_stats audio_output::stats() const {
+  return {
+      .underruns = m_underruns.load(std::memory_order_relaxed),
+      .buffers_played = m_buffers_played.load(std::memory_order_relaxed),
+      .queued_buffers = m_queued.load(std::memory_order_relaxed),
+      .min_queued_buffers = m_min_queued.load(std::memory_order_relaxed),
+  };
+}
+} // namespace libved
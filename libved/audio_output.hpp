@@ -0,0 +1,107 @@
+#pragma once
+
+#include <AL/al.h>
+#include <AL/alc.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace libved {
+struct audio_output_params {
+  int sample_rate = 48000;
+  int channels = 2;
+  // Latency is roughly buffer_count * buffer_samples / sample_rate; fewer or
+  // smaller buffers lower it at the cost of more underruns.
+  std::size_t buffer_count = 4;
+  std::size_t buffer_samples = 1024;
+};
+
+struct audio_output_stats {
+  // Times the source ran dry and had to be restarted.
+  std::uint64_t underruns = 0;
+  std::uint64_t buffers_played = 0;
+  // Buffers currently queued on the source, out of buffer_count.
+  std::size_t queued_buffers = 0;
+  // Fewest buffers that were queued since start(), a measure of how close
+  // playback came to an underrun.
+  std::size_t min_queued_buffers = 0;
+};
+
+// Fills `planes` (one per channel) with up to `samples` planar float
+// samples and returns how many it wrote. Called on the audio thread.
+using audio_source =
+    std::function<std::size_t(std::span<float *const> planes,
+                              std::size_t samples)>;
+
+// Streams audio into an OpenAL source through a ring of queued buffers,
+// refilled from `source` on a dedicated thread.
+class audio_output {
+public:
+  audio_output(audio_source source, audio_output_params params = {});
+  ~audio_output();
+
+  audio_output(const audio_output &) = delete;
+  audio_output &operator=(const audio_output &) = delete;
+
+  void start();
+  void stop();
+  void set_paused(bool paused);
+
+  // Samples the device has played since start().
+  [[nodiscard]] std::int64_t played_samples() const;
+  [[nodiscard]] std::chrono::nanoseconds position() const;
+  [[nodiscard]] audio_output_stats stats() const;
+  [[nodiscard]] const audio_output_params &params() const noexcept {
+    return m_params;
+  }
+
+private:
+  struct device_deleter {
+    void operator()(ALCdevice *d);
+  };
+  struct context_deleter {
+    void operator()(ALCcontext *c);
+  };
+
+  void run(std::stop_token stop);
+  // Returns false if the source had nothing to give.
+  bool fill(ALuint buffer);
+
+  audio_source m_source;
+  audio_output_params m_params;
+
+  std::unique_ptr<ALCdevice, device_deleter> m_device;
+  std::unique_ptr<ALCcontext, context_deleter> m_context;
+  ALuint m_al_source = 0;
+  std::vector<ALuint> m_buffers;
+  ALenum m_format = AL_NONE;
+  bool m_float_samples = false;
+  // Bytes per interleaved sample frame.
+  std::size_t m_frame_bytes = 0;
+
+  // Audio thread scratch space.
+  std::vector<float> m_planar;
+  std::vector<float *> m_planes;
+  std::vector<std::byte> m_interleaved;
+
+  // Guards unqueueing buffers together with m_processed_samples, so that
+  // the sample offset of the source is read against the matching count.
+  mutable std::mutex m_position_mutex;
+  std::int64_t m_processed_samples = 0;
+  std::atomic<bool> m_paused{false};
+  std::atomic<std::uint64_t> m_underruns{0};
+  std::atomic<std::uint64_t> m_buffers_played{0};
+  std::atomic<std::size_t> m_queued{0};
+  std::atomic<std::size_t> m_min_queued{0};
+
+  std::jthread m_thread;
+};
+} // namespace libved
@@ -0,0 +1,54 @@
+#include "disk_cache.hpp"
+#include <cstdlib>
+#include <fmt/core.h>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace libved {
+std::filesystem::path cache_directory(std::string_view name) {
+  std::filesystem::path base;
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME");
+      xdg != nullptr && *xdg != '\0') {
+    base = xdg;
+  } else if (const char *home = std::getenv("HOME"); home != nullptr) {
+    base = std::filesystem::path{home} / ".cache";
+  } else {
+    base = std::filesystem::temp_directory_path();
+  }
+  return base / "libved" / name;
+}
+
+void write_file_atomic(const std::filesystem::path &path,
+                       std::span<const std::byte> data) {
+  std::filesystem::create_directories(path.parent_path());
+  auto temp = path;
+  temp += fmt::format(".{}.tmp", getpid());
+  {
+    std::ofstream out{temp, std::ios::binary | std::ios::trunc};
+    out.write(reinterpret_cast<const char *>(data.data()),
+              static_cast<std::streamsize>(data.size()));
+    if (!out) {
+      throw std::runtime_error{
+          fmt::format("Unable to write cache file '{}'", temp.string())};
+    }
+  }
+  std::filesystem::rename(temp, path);
+}
+
+tl::optional<std::vector<std::byte>>
+read_file(const std::filesystem::path &path) {
+  std::ifstream in{path, std::ios::binary | std::ios::ate};
+  if (!in) {
+    return tl::nullopt;
+  }
+
+  std::vector<std::byte> data(static_cast<std::size_t>(in.tellg()));
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(data.data()),
+               static_cast<std::streamsize>(data.size()))) {
+    return tl::nullopt;
+  }
+  return data;
+}
+} // namespace libved
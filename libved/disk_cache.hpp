@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <tl/optional.hpp>
+#include <type_traits>
+#include <vector>
+
+namespace libved {
+// $XDG_CACHE_HOME/libved/<name>, falling back to ~/.cache/libved/<name>.
+[[nodiscard]] std::filesystem::path cache_directory(std::string_view name);
+
+// Writes to a temporary file first, so that readers never see a partially
+// written cache entry.
+void write_file_atomic(const std::filesystem::path &path,
+                       std::span<const std::byte> data);
+[[nodiscard]] tl::optional<std::vector<std::byte>>
+read_file(const std::filesystem::path &path);
+
+// Native-endian serialisation of trivially copyable values; cache files are
+// not meant to be moved between machines.
+class byte_writer {
+public:
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  void write(const T &value) {
+    write_bytes(std::as_bytes(std::span{&value, 1}));
+  }
+
+  void write_bytes(std::span<const std::byte> bytes) {
+    m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+  }
+
+  [[nodiscard]] std::span<const std::byte> data() const noexcept {
+    return m_data;
+  }
+
+private:
+  std::vector<std::byte> m_data;
+};
+
+class byte_reader {
+public:
+  byte_reader(std::span<const std::byte> data) : m_data{data} {}
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  bool read(T &value) {
+    if (m_data.size() < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, m_data.data(), sizeof(T));
+    m_data = m_data.subspan(sizeof(T));
+    return true;
+  }
+
+  tl::optional<std::span<const std::byte>> read_bytes(std::size_t count) {
+    if (m_data.size() < count) {
+      return tl::nullopt;
+    }
+    auto bytes = m_data.first(count);
+    m_data = m_data.subspan(count);
+    return bytes;
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return m_data.empty(); }
+
+private:
+  std::span<const std::byte> m_data;
+};
+} // namespace libved
@@ -1,10 +1,14 @@
 #include "display.hpp"
+#include "headless_display.hpp"
 #include "windowed_display.hpp"
 #include <memory>
 
 namespace libved {
 std::unique_ptr<display> create_display(const display_params &params,
                                         bool render) {
+  if (render) {
+    return std::make_unique<headless::offscreen>(params);
+  }
   return std::make_unique<windowed::window>(params);
 }
 
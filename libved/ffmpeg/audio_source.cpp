@@ -0,0 +1,169 @@
+#include "audio_source.hpp"
+#include "seekable_decoder.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errors.hpp>
+#include <spdlog/spdlog.h>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+namespace libved::ffmpeg {
+namespace {
+constexpr AVRational nanoseconds_base{1, 1'000'000'000};
+// Timestamps closer than this to where the previous anchor puts them are
+// rounding noise, not a gap.
+constexpr std::chrono::milliseconds anchor_tolerance{2};
+constexpr std::size_t max_anchors = 64;
+} // namespace
+
+decoded_audio_source::decoded_audio_source(codec_context &codec_ctx,
+                                           packet_queue &packets,
+                                           int sample_rate, int channels)
+    : m_codec_ctx{codec_ctx}, m_packets{packets},
+      m_resampler{sample_rate, channels}, m_packet{alloc_packet()},
+      m_frame{alloc_frame()} {}
+
+std::chrono::nanoseconds
+decoded_audio_source::extrapolate(const anchor &a, std::int64_t sample) const {
+  return a.time + std::chrono::nanoseconds{(sample - a.sample) *
+                                           1'000'000'000 /
+                                           m_resampler.sample_rate()};
+}
+
+void decoded_audio_source::add_anchor(const AVFrame &frm,
+                                      std::chrono::nanoseconds delay) {
+  const auto timestamp = frame_timestamp(&frm);
+  if (timestamp == AV_NOPTS_VALUE) {
+    return;
+  }
+
+  // The block starts with the samples the resampler held back, which
+  // came before this frame.
+  const anchor next{
+      .sample = m_delivered.load(std::memory_order_relaxed),
+      .time = std::chrono::nanoseconds{av_rescale_q(
+                  timestamp, m_codec_ctx->pkt_timebase, nanoseconds_base)} -
+              delay,
+  };
+  std::lock_guard lock{m_anchors_mutex};
+  if (!m_anchors.empty()) {
+    const auto expected = extrapolate(m_anchors.back(), next.sample);
+    if (std::chrono::abs(next.time - expected) < anchor_tolerance) {
+      return;
+    }
+    spdlog::debug("Audio timestamps jump by {} us",
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      next.time - expected)
+                      .count());
+  }
+  if (m_anchors.size() == max_anchors) {
+    m_anchors.pop_front();
+  }
+  m_anchors.push_back(next);
+}
+
+tl::optional<std::chrono::nanoseconds>
+decoded_audio_source::time_at(std::int64_t sample) const {
+  if (m_ended.load(std::memory_order_acquire) &&
+      sample >= m_delivered.load(std::memory_order_relaxed)) {
+    return tl::nullopt;
+  }
+
+  std::lock_guard lock{m_anchors_mutex};
+  if (m_anchors.empty()) {
+    return tl::nullopt;
+  }
+  auto it = std::find_if(m_anchors.rbegin(), m_anchors.rend(),
+                         [&](const anchor &a) { return a.sample <= sample; });
+  return extrapolate(it != m_anchors.rend() ? *it : m_anchors.front(),
+                     sample);
+}
+
+bool decoded_audio_source::refill() {
+  while (!m_done) {
+    auto received = m_codec_ctx.try_receive_frame(m_frame.get());
+    if (!received.has_value()) {
+      // Without new input a decoder fails the same way again, and one that
+      // is being drained gets none: the stream ends here.
+      if (received.error() == AVERROR(EINVAL) || m_draining) {
+        spdlog::warn("Stopping audio decoding: {}",
+                     ffmpeg_error{received.error()}.what());
+        m_done = true;
+        m_block = m_resampler.flush();
+        m_block_offset = 0;
+        return m_block.samples > 0;
+      }
+      // A corrupt frame only costs its own samples.
+      spdlog::debug("Skipping undecodable audio frame");
+    } else if (*received == send_receive_result::success) {
+      frame_unref_guard guard{m_frame};
+      const auto delay = m_resampler.delay_duration();
+      m_block = m_resampler.convert(*m_frame);
+      add_anchor(*m_frame, delay);
+      m_block_offset = 0;
+      if (m_block.samples > 0) {
+        return true;
+      }
+      continue;
+    } else if (*received == send_receive_result::eof) {
+      m_done = true;
+      m_block = m_resampler.flush();
+      m_block_offset = 0;
+      return m_block.samples > 0;
+    }
+
+    if (m_draining) {
+      continue;
+    }
+    using enum queue_result;
+    switch (m_packets.pop(m_packet)) {
+    case success: {
+      packet_unref_guard guard{m_packet};
+      m_codec_ctx.try_send_packet(m_packet.get());
+      break;
+    }
+    case flush:
+      m_codec_ctx.flush_buffers();
+      m_draining = false;
+      break;
+    case eof:
+      m_draining = true;
+      m_codec_ctx.try_send_packet(nullptr);
+      break;
+    default:
+      m_done = true;
+      break;
+    }
+  }
+  return false;
+}
+
+std::size_t decoded_audio_source::read(std::span<float *const> planes,
+                                       std::size_t samples) {
+  std::size_t written = 0;
+  while (written < samples) {
+    if (m_block_offset == static_cast<std::size_t>(m_block.samples) &&
+        !refill()) {
+      break;
+    }
+
+    const auto count =
+        std::min(samples - written,
+                 static_cast<std::size_t>(m_block.samples) - m_block_offset);
+    for (std::size_t c = 0; c < planes.size(); ++c) {
+      std::memcpy(planes[c] + written, m_block.planes[c] + m_block_offset,
+                  count * sizeof(float));
+    }
+    written += count;
+    m_block_offset += count;
+    m_delivered.fetch_add(static_cast<std::int64_t>(count),
+                          std::memory_order_relaxed);
+  }
+  if (m_done && m_block_offset == static_cast<std::size_t>(m_block.samples)) {
+    m_ended.store(true, std::memory_order_release);
+  }
+  return written;
+}
+} // namespace libved::ffmpeg
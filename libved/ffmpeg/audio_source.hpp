@@ -0,0 +1,67 @@
+#pragma once
+
+#include "packet_queue.hpp"
+#include "wrappers/avcodec.hpp"
+#include "wrappers/swresample.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <tl/optional.hpp>
+
+namespace libved::ffmpeg {
+// Decodes an audio stream fed by a packet_queue and resamples it to the
+// mixing format, handing samples out in whatever amounts the caller asks
+// for. read() has the signature of an audio_output source.
+class decoded_audio_source {
+public:
+  decoded_audio_source(codec_context &codec_ctx, packet_queue &packets,
+                       int sample_rate = 48000, int channels = 2);
+
+  // Fills `planes` with up to `samples` samples per channel, blocking for
+  // packets as needed. Returns fewer only at the end of the stream.
+  std::size_t read(std::span<float *const> planes, std::size_t samples);
+
+  // Stream time of the `sample`th sample handed out by read(), counting
+  // from the first. Empty before the first timestamped frame and once
+  // `sample` is past the end of the stream. Safe to call from any thread.
+  [[nodiscard]] tl::optional<std::chrono::nanoseconds>
+  time_at(std::int64_t sample) const;
+
+private:
+  // Stream time of one handed out sample, from which the following ones
+  // are extrapolated at the output rate.
+  struct anchor {
+    std::int64_t sample;
+    std::chrono::nanoseconds time;
+  };
+
+  // Records where the block just refilled from `frm` sits in the stream.
+  void add_anchor(const AVFrame &frm, std::chrono::nanoseconds delay);
+  [[nodiscard]] std::chrono::nanoseconds
+  extrapolate(const anchor &a, std::int64_t sample) const;
+
+  // Makes m_block hold unread samples. Returns false at the end of the
+  // stream.
+  bool refill();
+
+  codec_context &m_codec_ctx;
+  packet_queue &m_packets;
+  resample_context m_resampler;
+  packet m_packet;
+  frame m_frame;
+  audio_block m_block;
+  std::size_t m_block_offset = 0;
+  bool m_draining = false;
+  bool m_done = false;
+
+  std::atomic<std::int64_t> m_delivered{0};
+  std::atomic<bool> m_ended{false};
+  mutable std::mutex m_anchors_mutex;
+  // Only gaps and jumps in the timestamps add anchors, so this stays short.
+  std::deque<anchor> m_anchors;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,74 @@
+#include "av_sync.hpp"
+#include <spdlog/spdlog.h>
+
+namespace libved::ffmpeg {
+namespace {
+double to_ms(std::chrono::nanoseconds d) {
+  return std::chrono::duration<double, std::milli>{d}.count();
+}
+} // namespace
+
+sync_monitor::sync_monitor(sync_params params) : m_params{params} {}
+
+void sync_monitor::on_refresh(std::chrono::nanoseconds position,
+                              const presentation &shown) {
+  const auto now = clock::now();
+  if (!m_first_position.has_value()) {
+    m_first_position = position;
+    m_first_refresh = now;
+    m_last_report = now;
+  }
+  m_stats.clock_skew = (position - *m_first_position) - (now - m_first_refresh);
+
+  m_shown_stalled = m_shown_stalled || shown.stalled;
+  if (shown.changed) {
+    // The previous frame stayed up for longer than its duration without
+    // waiting on the decoder, so the clock was running behind the video.
+    if (m_stats.frames > 0 && !m_shown_stalled &&
+        m_shown_duration > std::chrono::nanoseconds{0} &&
+        now - m_shown_at > m_shown_duration + m_params.tolerance) {
+      ++m_stats.repeated;
+      spdlog::debug("Held a frame for {:.1f} ms to let the clock catch up",
+                    to_ms(now - m_shown_at - m_shown_duration));
+    }
+    if (shown.dropped > 0) {
+      m_stats.dropped += shown.dropped;
+      spdlog::debug("Dropped {} frames to catch up with the clock, {:.1f} ms "
+                    "behind",
+                    shown.dropped, to_ms(shown.drift));
+    }
+
+    ++m_stats.frames;
+    m_stats.last_drift = shown.drift;
+    m_total_drift += shown.drift;
+    m_stats.mean_drift =
+        m_total_drift / static_cast<std::int64_t>(m_stats.frames);
+    if (std::chrono::abs(shown.drift) > std::chrono::abs(m_stats.max_drift)) {
+      m_stats.max_drift = shown.drift;
+    }
+    if (std::chrono::abs(shown.drift) > m_params.tolerance) {
+      ++m_stats.out_of_sync;
+    }
+
+    m_shown_at = now;
+    m_shown_duration = shown.duration;
+    m_shown_stalled = false;
+  }
+
+  if (m_params.report_interval > std::chrono::nanoseconds{0} &&
+      now - m_last_report >= m_params.report_interval) {
+    m_last_report = now;
+    report();
+  }
+}
+
+void sync_monitor::report() const {
+  spdlog::info("A/V sync: drift {:.1f} ms (mean {:.1f}, max {:.1f}), {} of "
+               "{} frames out of sync, {} dropped, {} repeated, clock skew "
+               "{:.1f} ms",
+               to_ms(m_stats.last_drift), to_ms(m_stats.mean_drift),
+               to_ms(m_stats.max_drift), m_stats.out_of_sync, m_stats.frames,
+               m_stats.dropped, m_stats.repeated,
+               to_ms(m_stats.clock_skew));
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "frame_queue.hpp"
+#include <chrono>
+#include <cstdint>
+#include <tl/optional.hpp>
+
+namespace libved::ffmpeg {
+struct sync_params {
+  // Presented frames further than this from the clock count as out of
+  // sync.
+  std::chrono::nanoseconds tolerance = std::chrono::milliseconds{40};
+  // How often the sync metrics are logged; zero disables the log.
+  std::chrono::nanoseconds report_interval = std::chrono::seconds{10};
+};
+
+struct sync_stats {
+  std::uint64_t frames = 0;
+  // How far presented frames were behind the clock.
+  std::chrono::nanoseconds last_drift{0};
+  std::chrono::nanoseconds mean_drift{0};
+  std::chrono::nanoseconds max_drift{0};
+  std::uint64_t out_of_sync = 0;
+  // Corrections: frames skipped to catch up with the clock, and frames kept
+  // on screen past their duration because the clock fell behind them.
+  std::uint64_t dropped = 0;
+  std::uint64_t repeated = 0;
+  // How far the clock has gained on the system clock since the first
+  // refresh. Nonzero when slaved to an audio device with its own clock.
+  std::chrono::nanoseconds clock_skew{0};
+};
+
+// Measures how well video presentation follows the playback clock and logs
+// the drift and the corrections the frame_queue makes for it.
+class sync_monitor {
+public:
+  explicit sync_monitor(sync_params params = {});
+
+  // Records one refresh: `position` is the clock position the frame_queue
+  // was asked for and `shown` its answer.
+  void on_refresh(std::chrono::nanoseconds position, const presentation &shown);
+
+  [[nodiscard]] sync_stats stats() const { return m_stats; }
+  void report() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  sync_params m_params;
+  sync_stats m_stats;
+  // Sum of the drift of every presented frame, for the mean.
+  std::chrono::nanoseconds m_total_drift{0};
+
+  tl::optional<std::chrono::nanoseconds> m_first_position;
+  clock::time_point m_first_refresh;
+  clock::time_point m_last_report;
+
+  // The frame on screen, when it was shown and whether a decode stall
+  // rather than the clock kept it there.
+  clock::time_point m_shown_at;
+  std::chrono::nanoseconds m_shown_duration{0};
+  bool m_shown_stalled = false;
+};
+} // namespace libved::ffmpeg
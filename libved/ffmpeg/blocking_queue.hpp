@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <tl/optional.hpp>
+#include <utility>
+
+namespace libved::ffmpeg {
+// Bounded queue between threads, any number on either side. Meant for
+// handing over a few large items, e.g. frames, where a lock per item costs
+// nothing next to the work done on each.
+template <typename T> class blocking_queue {
+public:
+  explicit blocking_queue(std::size_t capacity) : m_capacity{capacity} {}
+
+  blocking_queue(const blocking_queue &) = delete;
+  blocking_queue &operator=(const blocking_queue &) = delete;
+
+  // Waits while the queue is full. Returns false, dropping `item`, once the
+  // queue has been finished or aborted.
+  bool push(T item) {
+    std::unique_lock lock{m_mutex};
+    if (m_items.size() >= m_capacity && !m_closed) {
+      ++m_stalls;
+      m_taken.wait(lock,
+                   [&] { return m_items.size() < m_capacity || m_closed; });
+    }
+    if (m_closed) {
+      return false;
+    }
+    m_items.push_back(std::move(item));
+    lock.unlock();
+    m_pushed.notify_one();
+    return true;
+  }
+
+  // Waits for the oldest item. Empty once the queue is finished and drained,
+  // or aborted.
+  tl::optional<T> pop() {
+    std::unique_lock lock{m_mutex};
+    m_pushed.wait(lock, [&] { return !m_items.empty() || m_closed; });
+    if (m_items.empty() || m_aborted) {
+      return tl::nullopt;
+    }
+    tl::optional<T> item{std::move(m_items.front())};
+    m_items.pop_front();
+    lock.unlock();
+    m_taken.notify_one();
+    return item;
+  }
+
+  // No more items will be pushed; those queued can still be popped.
+  void finish() { close(false); }
+  // Drops every queued item and wakes up both sides.
+  void abort() { close(true); }
+
+  // Pushes that had to wait for the consumer.
+  [[nodiscard]] std::uint64_t stalls() const {
+    std::lock_guard lock{m_mutex};
+    return m_stalls;
+  }
+
+private:
+  void close(bool abort) {
+    std::deque<T> dropped;
+    {
+      std::lock_guard lock{m_mutex};
+      m_closed = true;
+      m_aborted = m_aborted || abort;
+      if (abort) {
+        dropped.swap(m_items);
+      }
+    }
+    m_pushed.notify_all();
+    m_taken.notify_all();
+  }
+
+  std::size_t m_capacity;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_pushed;
+  std::condition_variable m_taken;
+  std::deque<T> m_items;
+  bool m_closed = false;
+  bool m_aborted = false;
+  std::uint64_t m_stalls = 0;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,142 @@
+#include "demuxer.hpp"
+#include <errors.hpp>
+#include <exception>
+#include <stdexcept>
+
+namespace libved::ffmpeg {
+demuxer::route::route(stream_queue_params params)
+    : params{params}, queue{params.capacity} {}
+
+demuxer::demuxer(format_context &format_ctx)
+    : m_format_ctx{format_ctx}, m_routes(format_ctx.streams().size()) {}
+
+demuxer::~demuxer() {
+  m_thread.request_stop();
+  for (auto &r : m_routes) {
+    if (r != nullptr) {
+      r->queue.abort();
+    }
+  }
+}
+
+packet_queue &demuxer::open_stream(std::size_t stream_index,
+                                   stream_queue_params params) {
+  if (m_thread.joinable()) {
+    throw std::logic_error{"demuxer streams must be opened before start()"};
+  }
+
+  auto &r = m_routes.at(stream_index);
+  r = std::make_unique<route>(params);
+  return r->queue;
+}
+
+void demuxer::discard_stream(std::size_t stream_index) {
+  auto &r = route_at(stream_index);
+  r.discard_requested.store(true, std::memory_order_release);
+  // The demuxer thread may be blocked pushing into this very queue, and
+  // would then never get to apply the discard.
+  r.queue.abort();
+}
+
+void demuxer::start() {
+  const auto streams = m_format_ctx.streams();
+  for (std::size_t i = 0; i < streams.size(); ++i) {
+    streams[i]->discard =
+        m_routes[i] == nullptr ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+  }
+
+  m_live_routes = 0;
+  for (const auto &r : m_routes) {
+    m_live_routes += r != nullptr ? 1 : 0;
+  }
+  m_thread = std::jthread{[this](std::stop_token stop) { run(stop); }};
+}
+
+packet_queue &demuxer::queue(std::size_t stream_index) {
+  return route_at(stream_index).queue;
+}
+
+std::size_t demuxer::dropped_packets(std::size_t stream_index) const {
+  return route_at(stream_index).dropped.load(std::memory_order_relaxed);
+}
+
+demuxer::route &demuxer::route_at(std::size_t stream_index) const {
+  const auto &r = m_routes.at(stream_index);
+  if (r == nullptr) {
+    throw std::out_of_range{"demuxer stream was not opened"};
+  }
+
+  return *r;
+}
+
+void demuxer::apply_discards() {
+  const auto streams = m_format_ctx.streams();
+  for (std::size_t i = 0; i < m_routes.size(); ++i) {
+    auto &r = m_routes[i];
+    if (r == nullptr || r->discarded ||
+        !r->discard_requested.load(std::memory_order_acquire)) {
+      continue;
+    }
+
+    streams[i]->discard = AVDISCARD_ALL;
+    r->discarded = true;
+    r->queue.finish();
+    --m_live_routes;
+  }
+}
+
+bool demuxer::route_packet(route &r, AVPacket *pkt) {
+  const auto is_keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+  if (r.waiting_for_keyframe && !is_keyframe) {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  auto result = r.params.policy == drop_policy::block ? r.queue.push(pkt)
+                                                      : r.queue.try_push(pkt);
+  if (result == queue_result::would_block) {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    r.waiting_for_keyframe =
+        r.params.policy == drop_policy::drop_until_keyframe;
+    return true;
+  }
+
+  r.waiting_for_keyframe = false;
+  return result != queue_result::aborted;
+}
+
+void demuxer::run(std::stop_token stop) {
+  try {
+    for (auto &&[pkt, guard] : m_format_ctx.read_frames()) {
+      if (stop.stop_requested()) {
+        return;
+      }
+
+      apply_discards();
+      if (m_live_routes == 0) {
+        return;
+      }
+
+      const auto index = static_cast<std::size_t>((*pkt)->stream_index);
+      if (index >= m_routes.size() || m_routes[index] == nullptr ||
+          m_routes[index]->discarded) {
+        continue;
+      }
+
+      // A consumer that aborted its queue is not interested anymore.
+      auto &r = *m_routes[index];
+      if (!route_packet(r, pkt->get())) {
+        r.discard_requested.store(true, std::memory_order_release);
+      }
+    }
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+
+  for (auto &r : m_routes) {
+    if (r != nullptr) {
+      r->queue.finish();
+    }
+  }
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "packet_queue.hpp"
+#include "wrappers/avformat.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace libved::ffmpeg {
+enum class drop_policy {
+  // Wait for the consumer. A stalled consumer stalls every other stream.
+  block,
+  // Drop packets that do not fit.
+  drop,
+  // Drop packets that do not fit, then everything up to the next keyframe,
+  // so that the decoder never sees a broken reference chain.
+  drop_until_keyframe,
+};
+
+struct stream_queue_params {
+  std::size_t capacity = 64;
+  drop_policy policy = drop_policy::block;
+};
+
+// Reads the container once on its own thread and routes each packet to the
+// packet_queue of its stream. Streams nobody opened are discarded in
+// libavformat, so their packets are skipped as cheaply as the demuxer allows.
+class demuxer {
+public:
+  demuxer(format_context &format_ctx);
+  ~demuxer();
+
+  demuxer(const demuxer &) = delete;
+  demuxer &operator=(const demuxer &) = delete;
+
+  // Must be called before start().
+  packet_queue &open_stream(std::size_t stream_index,
+                            stream_queue_params params = {});
+  // Can be called at any time, from any thread. Aborts the stream's queue,
+  // so packets still queued in it are dropped.
+  void discard_stream(std::size_t stream_index);
+
+  void start();
+
+  [[nodiscard]] packet_queue &queue(std::size_t stream_index);
+  [[nodiscard]] std::size_t dropped_packets(std::size_t stream_index) const;
+
+private:
+  struct route {
+    route(stream_queue_params params);
+
+    stream_queue_params params;
+    packet_queue queue;
+    std::atomic<bool> discard_requested{false};
+    std::atomic<std::size_t> dropped{0};
+    bool discarded = false;
+    bool waiting_for_keyframe = false;
+  };
+
+  void run(std::stop_token stop);
+  void apply_discards();
+  bool route_packet(route &r, AVPacket *pkt);
+  route &route_at(std::size_t stream_index) const;
+
+  format_context &m_format_ctx;
+  std::vector<std::unique_ptr<route>> m_routes;
+  std::size_t m_live_routes = 0;
+  std::jthread m_thread;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,232 @@
+#include "export_pipeline.hpp"
+#include <errors.hpp>
+#include <stdexcept>
+#include <utility>
+
+namespace libved::ffmpeg {
+export_pipeline::track::track(codec_context enc, std::size_t depth)
+    : encoder{std::move(enc)}, frames{depth} {}
+
+export_pipeline::export_pipeline(const char *url, export_params params)
+    : m_params{params}, m_output{url, params.format_name},
+      m_packets{params.packet_queue_depth} {}
+
+export_pipeline::~export_pipeline() {
+  abort();
+  join();
+}
+
+std::size_t export_pipeline::add_stream(codec_context encoder) {
+  if (m_started) {
+    throw std::logic_error{"Streams must be added before start()"};
+  }
+  m_tracks.push_back(std::make_unique<track>(std::move(encoder),
+                                             m_params.frame_queue_depth));
+  return m_tracks.size() - 1;
+}
+
+void export_pipeline::start() {
+  for (auto &t : m_tracks) {
+    auto *enc = t->encoder.get();
+    // Rendered frames are BT.709, limited range unless asked otherwise.
+    if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+      if (enc->colorspace == AVCOL_SPC_UNSPECIFIED) {
+        enc->colorspace = AVCOL_SPC_BT709;
+      }
+      if (enc->color_range == AVCOL_RANGE_UNSPECIFIED) {
+        enc->color_range = AVCOL_RANGE_MPEG;
+      }
+      if (enc->color_primaries == AVCOL_PRI_UNSPECIFIED) {
+        enc->color_primaries = AVCOL_PRI_BT709;
+      }
+      if (enc->color_trc == AVCOL_TRC_UNSPECIFIED) {
+        enc->color_trc = AVCOL_TRC_BT709;
+      }
+    }
+    m_output.prepare_encoder(t->encoder);
+    t->encoder.set_threading(m_params.threading);
+    t->encoder.init();
+    t->stream = m_output.add_stream(t->encoder);
+  }
+  m_output.write_header();
+  m_started = true;
+
+  m_muxer = std::jthread{[this] { mux(); }};
+  for (auto &t : m_tracks) {
+    t->thread = std::jthread{[this, &t = *t] { encode(t); }};
+  }
+}
+
+bool export_pipeline::push(std::size_t stream, frame frm) {
+  return m_tracks.at(stream)->frames.push(std::move(frm));
+}
+
+bool export_pipeline::push(std::size_t stream, vaapi::readback_frame frm,
+                           std::int64_t pts) {
+  return m_tracks.at(stream)->frames.push(
+      rendered{.pixels = std::move(frm), .pts = pts});
+}
+
+void export_pipeline::finish() {
+  for (auto &t : m_tracks) {
+    t->frames.finish();
+  }
+  for (auto &t : m_tracks) {
+    if (t->thread.joinable()) {
+      t->thread.join();
+    }
+  }
+  m_packets.finish();
+  join();
+
+  std::exception_ptr error;
+  {
+    std::lock_guard lock{m_mutex};
+    error = m_error;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if (m_started) {
+    m_output.write_trailer();
+    m_started = false;
+  }
+}
+
+export_stats export_pipeline::stats() const {
+  export_stats stats;
+  {
+    std::lock_guard lock{m_mutex};
+    stats = m_stats;
+  }
+  for (const auto &t : m_tracks) {
+    stats.render_stalls += t->frames.stalls();
+  }
+  stats.encode_stalls = m_packets.stalls();
+  return stats;
+}
+
+void export_pipeline::encode(track &t) {
+  try {
+    while (auto in = t.frames.pop()) {
+      auto frm = std::holds_alternative<frame>(*in)
+                     ? std::move(std::get<frame>(*in))
+                     : convert(t, std::get<rendered>(*in));
+      // Hands the pixel buffer back before encoding.
+      in = tl::nullopt;
+      if (!drain(t, frm.get())) {
+        return;
+      }
+      std::lock_guard lock{m_mutex};
+      ++m_stats.frames_encoded;
+    }
+    {
+      std::lock_guard lock{m_mutex};
+      if (m_error) {
+        return;
+      }
+    }
+    drain(t, nullptr);
+  } catch (...) {
+    fail(std::current_exception());
+  }
+}
+
+bool export_pipeline::drain(track &t, const AVFrame *frm) {
+  while (true) {
+    // A full encoder takes no input until its packets have been taken out.
+    const auto sent = t.encoder.send_frame(frm);
+    while (true) {
+      auto pkt = m_packet_pool.get();
+      if (t.encoder.receive_packet(pkt) != send_receive_result::success) {
+        break;
+      }
+      if (!m_packets.push(encoded{.pkt = std::move(pkt),
+                                  .stream = t.stream,
+                                  .time_base = t.encoder->time_base})) {
+        return false;
+      }
+    }
+    if (sent != send_receive_result::eagain) {
+      return true;
+    }
+  }
+}
+
+frame export_pipeline::convert(track &t, const rendered &r) {
+  const auto &pixels = r.pixels;
+  const bool nv12 = pixels.format() == vaapi::readback_format::nv12;
+  // Points straight into the mapped pixel-pack buffer.
+  auto src = m_pool.get();
+  src->width = pixels.width();
+  src->height = pixels.height();
+  src->format = nv12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_RGBA;
+  for (std::size_t i = 0; i < (nv12 ? 2U : 1U); ++i) {
+    src->data[i] = const_cast<std::uint8_t *>(pixels.plane(i).data());
+    src->linesize[i] = static_cast<int>(pixels.stride(i));
+  }
+
+  const auto *enc = t.encoder.get();
+  auto dst = m_pool.get(enc->width, enc->height, enc->pix_fmt);
+  if (src->format == enc->pix_fmt && src->width == enc->width &&
+      src->height == enc->height) {
+    call_and_handle_error(
+        throw_nested_runtime_error("Unable to copy read back frame"),
+        av_frame_copy, dst.get(), src.get());
+  } else {
+    // The read back NV12 is limited range, RGBA is full range.
+    t.scaler.set_colorspace(SWS_CS_ITU709, !nv12,
+                            enc->color_range == AVCOL_RANGE_JPEG);
+    t.scaler.scale(*src, enc->width, enc->height, enc->pix_fmt, dst->data,
+                   dst->linesize);
+  }
+  dst->colorspace = enc->colorspace;
+  dst->color_range = enc->color_range;
+  dst->color_primaries = enc->color_primaries;
+  dst->color_trc = enc->color_trc;
+  dst->pts = r.pts;
+  return dst;
+}
+
+void export_pipeline::mux() {
+  try {
+    while (auto item = m_packets.pop()) {
+      const auto size = static_cast<std::uint64_t>(item->pkt->size);
+      m_output.write_packet(item->pkt.get(), item->stream, item->time_base);
+      std::lock_guard lock{m_mutex};
+      ++m_stats.packets_written;
+      m_stats.bytes_written += size;
+    }
+  } catch (...) {
+    fail(std::current_exception());
+  }
+}
+
+void export_pipeline::fail(std::exception_ptr error) {
+  {
+    std::lock_guard lock{m_mutex};
+    if (!m_error) {
+      m_error = std::move(error);
+    }
+  }
+  abort();
+}
+
+void export_pipeline::abort() {
+  for (auto &t : m_tracks) {
+    t->frames.abort();
+  }
+  m_packets.abort();
+}
+
+void export_pipeline::join() {
+  for (auto &t : m_tracks) {
+    if (t->thread.joinable()) {
+      t->thread.join();
+    }
+  }
+  if (m_muxer.joinable()) {
+    m_muxer.join();
+  }
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "blocking_queue.hpp"
+#include "pbo_readback.hpp"
+#include "pools.hpp"
+#include "wrappers/avcodec.hpp"
+#include "wrappers/avformat.hpp"
+#include "wrappers/avutil.hpp"
+#include "wrappers/swscale.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct export_params {
+  // Frames queued per stream ahead of its encoder.
+  std::size_t frame_queue_depth = 4;
+  // Encoded packets queued ahead of the muxer, for all streams together.
+  std::size_t packet_queue_depth = 64;
+  threading_policy threading{};
+  // Overrides guessing the container from the output url.
+  const char *format_name = nullptr;
+};
+
+struct export_stats {
+  std::uint64_t frames_encoded = 0;
+  std::uint64_t packets_written = 0;
+  std::uint64_t bytes_written = 0;
+  // Pushes that had to wait for an encoder to catch up.
+  std::uint64_t render_stalls = 0;
+  // Packets that had to wait for the muxer to catch up.
+  std::uint64_t encode_stalls = 0;
+};
+
+// Encodes and muxes rendered frames in the background. Every stream has an
+// encoder thread of its own, on top of the encoder's internal threading, and
+// one more thread writes the packets of all streams, so that while frame
+// N + 2 is being rendered, N + 1 is being encoded and N written out.
+class export_pipeline {
+public:
+  explicit export_pipeline(const char *url, export_params params = {});
+  // Abandons the export unless finish() has been called.
+  ~export_pipeline();
+
+  export_pipeline(const export_pipeline &) = delete;
+  export_pipeline &operator=(const export_pipeline &) = delete;
+
+  // `encoder` must be configured, codec parameters and time base included,
+  // but not initialised yet. Streams are added before start().
+  std::size_t add_stream(codec_context encoder);
+  // Opens the encoders, writes the container header and starts the threads.
+  void start();
+
+  // Queues a frame whose pts is in the encoder's time base, waiting while
+  // the encoder is behind. Returns false once the export has failed.
+  bool push(std::size_t stream, frame frm);
+  // Queues a read back frame. It is converted to the encoder's pixel format
+  // and size on the encoder thread, which releases the pixel buffer.
+  bool push(std::size_t stream, vaapi::readback_frame frm, std::int64_t pts);
+
+  // Drains the encoders and writes the trailer. Rethrows the first error of
+  // any thread.
+  void finish();
+
+  [[nodiscard]] export_stats stats() const;
+
+private:
+  struct rendered {
+    vaapi::readback_frame pixels;
+    std::int64_t pts;
+  };
+  using input = std::variant<frame, rendered>;
+
+  struct encoded {
+    packet pkt;
+    std::size_t stream;
+    AVRational time_base;
+  };
+
+  struct track {
+    track(codec_context enc, std::size_t depth);
+
+    codec_context encoder;
+    blocking_queue<input> frames;
+    std::size_t stream = 0;
+    scale_context scaler;
+    std::jthread thread;
+  };
+
+  void encode(track &t);
+  // Sends `frm`, or flushes the encoder if it is null, and queues every
+  // packet that comes out. Returns false if the export was aborted.
+  bool drain(track &t, const AVFrame *frm);
+  frame convert(track &t, const rendered &r);
+  void mux();
+  void fail(std::exception_ptr error);
+  void abort();
+  void join();
+
+  export_params m_params;
+  output_format_context m_output;
+  frame_pool m_pool;
+  packet_pool m_packet_pool;
+  std::vector<std::unique_ptr<track>> m_tracks;
+  blocking_queue<encoded> m_packets;
+  std::jthread m_muxer;
+  bool m_started = false;
+
+  mutable std::mutex m_mutex;
+  std::exception_ptr m_error;
+  export_stats m_stats;
+};
+} // namespace libved::ffmpeg
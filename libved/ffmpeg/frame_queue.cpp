@@ -0,0 +1,134 @@
+#include "frame_queue.hpp"
+#include "seekable_decoder.hpp"
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+namespace libved::ffmpeg {
+namespace {
+constexpr AVRational nanoseconds_base{1, 1'000'000'000};
+} // namespace
+
+frame_queue::frame_queue(AVRational time_base, frame_queue_params params)
+    : m_time_base{time_base}, m_params{params} {
+  m_params.depth = std::max<std::size_t>(m_params.depth, 1);
+}
+
+std::chrono::nanoseconds frame_queue::time_of(const AVFrame *frm) const {
+  const auto timestamp = frame_timestamp(frm);
+  if (timestamp == AV_NOPTS_VALUE) {
+    return m_current_end;
+  }
+  return std::chrono::nanoseconds{
+      av_rescale_q(timestamp, m_time_base, nanoseconds_base)};
+}
+
+bool frame_queue::push(frame frm) {
+  std::unique_lock lock{m_mutex};
+  m_space_available.wait(
+      lock, [&] { return m_aborted || m_frames.size() < m_params.depth; });
+  if (m_aborted) {
+    return false;
+  }
+  m_frames.push_back(std::move(frm));
+  m_frame_ready.notify_all();
+  return true;
+}
+
+void frame_queue::finish() {
+  std::lock_guard lock{m_mutex};
+  m_finished = true;
+  m_frame_ready.notify_all();
+}
+
+void frame_queue::clear() {
+  std::lock_guard lock{m_mutex};
+  m_frames.clear();
+  m_finished = false;
+  m_space_available.notify_all();
+}
+
+void frame_queue::abort() {
+  std::lock_guard lock{m_mutex};
+  m_aborted = true;
+  m_space_available.notify_all();
+  m_frame_ready.notify_all();
+}
+
+tl::optional<std::chrono::nanoseconds> frame_queue::wait_next_time() {
+  std::unique_lock lock{m_mutex};
+  m_frame_ready.wait(
+      lock, [&] { return m_aborted || m_finished || !m_frames.empty(); });
+  if (m_aborted || m_frames.empty()) {
+    return tl::nullopt;
+  }
+  return time_of(m_frames.front().get());
+}
+
+bool frame_queue::finished() const {
+  std::lock_guard lock{m_mutex};
+  return m_aborted || (m_finished && m_frames.empty());
+}
+
+presentation_stats frame_queue::stats() const {
+  std::lock_guard lock{m_mutex};
+  return m_stats;
+}
+
+presentation frame_queue::frame_for(std::chrono::nanoseconds position) {
+  std::lock_guard lock{m_mutex};
+  frame next;
+  std::uint32_t dropped = 0;
+  while (!m_frames.empty() && time_of(m_frames.front().get()) <= position) {
+    if (next != nullptr) {
+      ++m_stats.dropped;
+      ++dropped;
+    }
+    next = std::move(m_frames.front());
+    m_frames.pop_front();
+    m_space_available.notify_all();
+    if (!m_params.drop_late) {
+      break;
+    }
+  }
+
+  if (next == nullptr) {
+    // Count each stall once, not once per refresh.
+    const bool underrun = m_current != nullptr && m_frames.empty() &&
+                          !m_finished && position > m_current_end;
+    if (underrun && !m_underrun) {
+      ++m_stats.duplicated;
+    }
+    m_underrun = underrun;
+    return {
+        .frm = m_current != nullptr ? &m_current : nullptr,
+        .stalled = underrun,
+        .duration = m_current_end - m_current_start,
+    };
+  }
+
+  const auto start = time_of(next.get());
+  const auto drift = position - start;
+  if (drift > m_params.late_threshold) {
+    ++m_stats.late;
+  }
+  ++m_stats.presented;
+  m_underrun = false;
+  m_current_end =
+      start + (next->duration > 0
+                   ? std::chrono::nanoseconds{av_rescale_q(
+                         next->duration, m_time_base, nanoseconds_base)}
+                   : std::chrono::nanoseconds{0});
+  m_current_start = start;
+  m_current = std::move(next);
+  return {
+      .frm = &m_current,
+      .changed = true,
+      .dropped = dropped,
+      .drift = drift,
+      .duration = m_current_end - start,
+  };
+}
+} // namespace libved::ffmpeg
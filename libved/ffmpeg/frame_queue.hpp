@@ -0,0 +1,102 @@
+#pragma once
+
+#include "wrappers/avutil.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <tl/optional.hpp>
+
+namespace libved::ffmpeg {
+struct frame_queue_params {
+  // Decoded frames kept ahead of the one on screen.
+  std::size_t depth = 8;
+  // Skip frames whose successor is already due instead of showing every
+  // frame late.
+  bool drop_late = true;
+  // Frames shown more than this after their pts count as late.
+  std::chrono::nanoseconds late_threshold = std::chrono::milliseconds{20};
+};
+
+struct presentation_stats {
+  std::uint64_t presented = 0;
+  // Frames never shown because a later frame was already due.
+  std::uint64_t dropped = 0;
+  // Times the frame on screen was kept past its duration because the next
+  // one had not been decoded yet.
+  std::uint64_t duplicated = 0;
+  std::uint64_t late = 0;
+};
+
+struct presentation {
+  // The frame to show, or nullptr if none is due yet.
+  const frame *frm = nullptr;
+  // Whether `frm` differs from the previous call's, i.e. needs uploading.
+  bool changed = false;
+  // Frames skipped on this call because a later one was already due.
+  std::uint32_t dropped = 0;
+  // Whether the frame on screen has outlived its duration because the next
+  // one has not been decoded yet.
+  bool stalled = false;
+  // How far `frm` is behind the position it was picked for, if it changed.
+  std::chrono::nanoseconds drift{0};
+  // How long `frm` should stay on screen, 0 if unknown.
+  std::chrono::nanoseconds duration{0};
+};
+
+// Bounded queue of decoded frames between a decode thread and a presenter
+// that picks frames by pts, so that frames which take longer than a refresh
+// interval to decode are absorbed by the frames decoded ahead of them.
+class frame_queue {
+public:
+  // `time_base` is the time base of the frames' timestamps.
+  frame_queue(AVRational time_base, frame_queue_params params = {});
+
+  frame_queue(const frame_queue &) = delete;
+  frame_queue &operator=(const frame_queue &) = delete;
+
+  // Decode side. Blocks while the queue is full; returns false once
+  // aborted.
+  bool push(frame frm);
+  // No more frames until the next clear().
+  void finish();
+  // Drops every queued frame, e.g. after a seek.
+  void clear();
+
+  // Either side. Wakes up a blocked push() and makes it return false.
+  void abort();
+
+  // Presenter side. `position` is the stream time to show, in the same
+  // clock as the frames' pts.
+  [[nodiscard]] presentation frame_for(std::chrono::nanoseconds position);
+  // Timestamp of the next frame to show, waiting for it to be decoded.
+  // Empty once the queue is finished and drained, or aborted.
+  [[nodiscard]] tl::optional<std::chrono::nanoseconds> wait_next_time();
+  // True once finish() was called and every frame has been presented.
+  [[nodiscard]] bool finished() const;
+
+  [[nodiscard]] presentation_stats stats() const;
+
+private:
+  [[nodiscard]] std::chrono::nanoseconds time_of(const AVFrame *frm) const;
+
+  AVRational m_time_base;
+  frame_queue_params m_params;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_space_available;
+  std::condition_variable m_frame_ready;
+  std::deque<frame> m_frames;
+  bool m_finished = false;
+  bool m_aborted = false;
+  presentation_stats m_stats;
+
+  // Only touched by the presenter.
+  frame m_current;
+  std::chrono::nanoseconds m_current_start{0};
+  std::chrono::nanoseconds m_current_end{0};
+  bool m_underrun = false;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,153 @@
+#include "gop_decoder.hpp"
+#include "seekable_decoder.hpp"
+#include "wrappers/avformat.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace libved::ffmpeg {
+gop_decoder::gop_decoder(const char *path, const seek_index &index,
+                         gop_decoder_params params)
+    : m_path{path}, m_index{index}, m_params{params} {
+  const auto keyframes = m_index.keyframes();
+  const auto step = std::max<std::size_t>(m_params.keyframes_per_segment, 1);
+  for (std::size_t i = 0; i < keyframes.size(); i += step) {
+    const auto next = i + step;
+    m_segments.push_back({
+        .start = keyframes[i].pts,
+        .end = next < keyframes.size()
+                   ? keyframes[next].pts
+                   : std::numeric_limits<std::int64_t>::max(),
+    });
+  }
+  m_stats.segments = m_segments.size();
+
+  auto workers = m_params.workers != 0
+                     ? m_params.workers
+                     : std::max(std::thread::hardware_concurrency(), 1U);
+  workers = std::min(workers, m_segments.size());
+  for (std::size_t i = 0; i < workers; ++i) {
+    m_workers.emplace_back([this](std::stop_token stop) { run(stop); });
+  }
+}
+
+gop_decoder::~gop_decoder() {
+  for (auto &worker : m_workers) {
+    worker.request_stop();
+  }
+}
+
+gop_decoder_stats gop_decoder::stats() const {
+  std::lock_guard lock{m_mutex};
+  return m_stats;
+}
+
+bool gop_decoder::read_frame(AVFrame *out) {
+  std::unique_lock lock{m_mutex};
+  while (m_current_segment < m_segments.size()) {
+    auto &seg = m_segments[m_current_segment];
+    m_frame_ready.wait(lock, [&] {
+      return !seg.frames.empty() || seg.done || seg.error != nullptr;
+    });
+    if (!seg.frames.empty()) {
+      av_frame_unref(out);
+      av_frame_move_ref(out, seg.frames.front().get());
+      seg.frames.pop_front();
+      ++m_stats.frames;
+      m_space_available.notify_all();
+      return true;
+    }
+    if (seg.error != nullptr) {
+      std::rethrow_exception(seg.error);
+    }
+
+    ++m_current_segment;
+    // Workers holding later segments may have been waiting for this one.
+    m_space_available.notify_all();
+  }
+  return false;
+}
+
+bool gop_decoder::push_frame(std::stop_token stop, std::size_t index,
+                             frame frm) {
+  std::unique_lock lock{m_mutex};
+  auto &seg = m_segments[index];
+  // The segment being read is drained by the reader, so only later segments
+  // are bounded.
+  if (!m_space_available.wait(lock, stop, [&] {
+        return index == m_current_segment ||
+               seg.frames.size() < m_params.max_buffered_frames;
+      })) {
+    return false;
+  }
+  seg.frames.push_back(std::move(frm));
+  m_frame_ready.notify_all();
+  return true;
+}
+
+void gop_decoder::decode_segment(std::stop_token stop, std::size_t index,
+                                 seekable_decoder &decoder) {
+  const auto start = m_segments[index].start;
+  const auto end = m_segments[index].end;
+  std::size_t discarded = 0;
+
+  auto frm = m_frame_pool.get();
+  bool has_frame = decoder.seek_to(start, frm);
+  while (has_frame && !stop.stop_requested()) {
+    const auto timestamp = frame_timestamp(frm.get());
+    if (timestamp != AV_NOPTS_VALUE && timestamp >= end) {
+      break;
+    }
+    if (timestamp != AV_NOPTS_VALUE && timestamp < start) {
+      ++discarded;
+    } else if (!push_frame(stop, index, std::move(frm))) {
+      return;
+    } else {
+      frm = m_frame_pool.get();
+    }
+    has_frame = decoder.read_frame(frm);
+  }
+
+  std::lock_guard lock{m_mutex};
+  m_stats.discarded_frames += discarded;
+}
+
+void gop_decoder::run(std::stop_token stop) {
+  auto index = format_context::npos;
+  try {
+    format_context format_ctx{m_path.c_str()};
+    codec_context codec_ctx{*format_ctx.streams()[m_index.stream_index()]};
+    codec_ctx.set_threading(m_params.threading);
+    codec_ctx.init();
+    seekable_decoder decoder{format_ctx, codec_ctx, m_index.stream_index(),
+                             &m_index};
+
+    while (!stop.stop_requested()) {
+      {
+        std::lock_guard lock{m_mutex};
+        if (m_next_segment == m_segments.size()) {
+          return;
+        }
+        index = m_next_segment++;
+      }
+
+      decode_segment(stop, index, decoder);
+
+      std::lock_guard lock{m_mutex};
+      m_segments[index].done = true;
+      m_frame_ready.notify_all();
+    }
+  } catch (...) {
+    std::lock_guard lock{m_mutex};
+    // Fail the segment this worker was on; if the worker could not even be
+    // set up, fail the next one it would have taken.
+    if (index == format_context::npos) {
+      if (m_next_segment == m_segments.size()) {
+        return;
+      }
+      index = m_next_segment++;
+    }
+    m_segments[index].error = std::current_exception();
+    m_frame_ready.notify_all();
+  }
+}
+} // namespace libved::ffmpeg
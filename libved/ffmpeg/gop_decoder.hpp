@@ -0,0 +1,96 @@
+#pragma once
+
+#include "pools.hpp"
+#include "seek_index.hpp"
+#include "wrappers/avcodec.hpp"
+#include "wrappers/avutil.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct gop_decoder_params {
+  // 0 uses one worker per CPU.
+  std::size_t workers = 0;
+  // Consecutive GOPs handed to a worker at once. Larger segments waste less
+  // work on seeking, smaller ones balance better.
+  std::size_t keyframes_per_segment = 1;
+  // Decoded frames a worker may hold for a segment that is not being read
+  // yet.
+  std::size_t max_buffered_frames = 8;
+  // Threading of each worker's own codec_context.
+  threading_policy threading{threading_mode::slice, 1};
+};
+
+struct gop_decoder_stats {
+  std::size_t segments = 0;
+  std::size_t frames = 0;
+  // Frames decoded outside of their segment, e.g. the leading frames of an
+  // open GOP that the previous segment already produced.
+  std::size_t discarded_frames = 0;
+};
+
+// Decodes one video stream for export by splitting it into keyframe-delimited
+// segments and decoding several segments at once, each on its own
+// format_context and codec_context. Frames come out in presentation order.
+//
+// A segment owns the frames with start <= pts < end, where start and end are
+// the pts of its first keyframe and of the next segment's. Frames of an open
+// GOP that reference the previous GOP therefore belong to the segment that
+// can actually decode them.
+class gop_decoder {
+public:
+  gop_decoder(const char *path, const seek_index &index,
+              gop_decoder_params params = {});
+  ~gop_decoder();
+
+  gop_decoder(const gop_decoder &) = delete;
+  gop_decoder &operator=(const gop_decoder &) = delete;
+
+  // Next frame in presentation order. Returns false at the end of the
+  // stream; rethrows the first error of the worker decoding it.
+  bool read_frame(AVFrame *out);
+  decltype(auto) read_frame(const frame &frm) { return read_frame(frm.get()); }
+
+  [[nodiscard]] std::size_t workers() const noexcept {
+    return m_workers.size();
+  }
+  [[nodiscard]] gop_decoder_stats stats() const;
+
+private:
+  struct segment {
+    std::int64_t start;
+    std::int64_t end;
+    std::deque<frame> frames;
+    bool done = false;
+    std::exception_ptr error;
+  };
+
+  void run(std::stop_token stop);
+  void decode_segment(std::stop_token stop, std::size_t index,
+                      class seekable_decoder &decoder);
+  bool push_frame(std::stop_token stop, std::size_t index, frame frm);
+
+  std::string m_path;
+  const seek_index &m_index;
+  gop_decoder_params m_params;
+  std::deque<segment> m_segments;
+  frame_pool m_frame_pool;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable_any m_frame_ready;
+  std::condition_variable_any m_space_available;
+  std::size_t m_next_segment = 0;
+  std::size_t m_current_segment = 0;
+  gop_decoder_stats m_stats;
+
+  std::vector<std::jthread> m_workers;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,184 @@
+#include "managers.hpp"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace libved::ffmpeg {
+struct format_context_lease::state {
+  struct entry {
+    file_identity identity;
+    std::shared_ptr<const media_info> info;
+    std::vector<std::unique_ptr<format_context>> idle;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  std::size_t max_entries;
+  std::size_t max_idle_per_entry;
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, entry> entries;
+  // Most recently used first.
+  std::list<std::string> lru;
+  format_context_manager_stats stats;
+
+  // Returns the idle contexts of the removed entry, so that they can be
+  // closed outside of the lock.
+  std::vector<std::unique_ptr<format_context>>
+  erase(std::unordered_map<std::string, entry>::iterator it) {
+    auto idle = std::move(it->second.idle);
+    lru.erase(it->second.lru_position);
+    entries.erase(it);
+    return idle;
+  }
+
+  void release(const std::string &path, const file_identity &identity,
+               std::unique_ptr<format_context> context) {
+    std::unique_lock lock{mutex};
+    const auto it = entries.find(path);
+    if (it == entries.end() || it->second.identity != identity ||
+        it->second.idle.size() >= max_idle_per_entry) {
+      lock.unlock();
+      return;
+    }
+    it->second.idle.push_back(std::move(context));
+  }
+};
+
+format_context_lease::format_context_lease(
+    std::weak_ptr<state> owner, std::string path, file_identity identity,
+    std::unique_ptr<format_context> context,
+    std::shared_ptr<const media_info> info)
+    : m_owner{std::move(owner)}, m_path{std::move(path)},
+      m_identity{identity}, m_context{std::move(context)},
+      m_info{std::move(info)} {}
+
+format_context_lease::~format_context_lease() {
+  if (m_context == nullptr) {
+    return;
+  }
+
+  if (const auto owner = m_owner.lock(); owner != nullptr) {
+    owner->release(m_path, m_identity, std::move(m_context));
+  }
+}
+
+format_context_manager::format_context_manager(
+    std::size_t max_entries, std::size_t max_idle_per_entry,
+    std::shared_ptr<const probe_cache> disk_cache)
+    : m_state{std::make_shared<format_context_lease::state>()},
+      m_disk_cache{std::move(disk_cache)} {
+  m_state->max_entries = std::max<std::size_t>(max_entries, 1);
+  m_state->max_idle_per_entry = max_idle_per_entry;
+}
+
+// Undoes whatever the previous lease holder did to the context.
+static bool reset_for_reuse(format_context &format_ctx) {
+  for (auto *st : format_ctx.streams()) {
+    st->discard = AVDISCARD_DEFAULT;
+  }
+
+  const auto start =
+      format_ctx->start_time == AV_NOPTS_VALUE ? 0 : format_ctx->start_time;
+  return avformat_seek_file(format_ctx.get(), -1,
+                            std::numeric_limits<std::int64_t>::min(), start,
+                            start, 0) >= 0;
+}
+
+format_context_lease format_context_manager::acquire(const char *path) {
+  const auto identity = file_identity::of(path);
+  const std::string key{path};
+  std::unique_ptr<format_context> context;
+  std::shared_ptr<const media_info> info;
+  std::vector<std::unique_ptr<format_context>> stale;
+  {
+    std::lock_guard lock{m_state->mutex};
+    auto it = m_state->entries.find(key);
+    if (it != m_state->entries.end() && it->second.identity != identity) {
+      stale = m_state->erase(it);
+      it = m_state->entries.end();
+    }
+
+    if (it != m_state->entries.end()) {
+      auto &e = it->second;
+      m_state->lru.splice(m_state->lru.begin(), m_state->lru, e.lru_position);
+      info = e.info;
+      if (!e.idle.empty()) {
+        context = std::move(e.idle.back());
+        e.idle.pop_back();
+      }
+    }
+  }
+  stale.clear();
+
+  if (context != nullptr && reset_for_reuse(*context)) {
+    std::lock_guard lock{m_state->mutex};
+    ++m_state->stats.hits;
+    return {m_state, key, identity, std::move(context), std::move(info)};
+  }
+
+  const auto begin = std::chrono::steady_clock::now();
+  bool reuse_probe = false;
+  if (info != nullptr) {
+    if (auto format_ctx = info->fast_open(path); format_ctx.has_value()) {
+      context = std::make_unique<format_context>(std::move(*format_ctx));
+      reuse_probe = true;
+    }
+  }
+  if (!reuse_probe && m_disk_cache != nullptr) {
+    auto probed = m_disk_cache->open(path, identity);
+    context = std::make_unique<format_context>(std::move(probed.context));
+    info = std::move(probed.info);
+    reuse_probe = probed.cached;
+  } else if (!reuse_probe) {
+    context = std::make_unique<format_context>(path);
+    info = std::make_shared<const media_info>(media_info::capture(*context));
+  }
+  const auto open_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  {
+    std::lock_guard lock{m_state->mutex};
+    auto &stats = m_state->stats;
+    ++(reuse_probe ? stats.probe_hits : stats.misses);
+    stats.total_open_time += open_time;
+    stats.max_open_time = std::max(stats.max_open_time, open_time);
+
+    if (auto it = m_state->entries.find(key); it == m_state->entries.end()) {
+      m_state->lru.push_front(key);
+      m_state->entries.emplace(
+          key, format_context_lease::state::entry{
+                   .identity = identity,
+                   .info = info,
+                   .lru_position = m_state->lru.begin(),
+               });
+    } else if (!reuse_probe) {
+      // The file was probed again; the snapshot held so far is stale.
+      it->second.info = info;
+    }
+
+    while (m_state->entries.size() > m_state->max_entries) {
+      auto evicted = m_state->erase(m_state->entries.find(m_state->lru.back()));
+      ++stats.evictions;
+      std::move(evicted.begin(), evicted.end(), std::back_inserter(stale));
+    }
+  }
+
+  return {m_state, key, identity, std::move(context), std::move(info)};
+}
+
+void format_context_manager::clear() {
+  std::unordered_map<std::string, format_context_lease::state::entry> entries;
+  {
+    std::lock_guard lock{m_state->mutex};
+    entries = std::move(m_state->entries);
+    m_state->entries.clear();
+    m_state->lru.clear();
+  }
+}
+
+format_context_manager_stats format_context_manager::stats() const {
+  std::lock_guard lock{m_state->mutex};
+  return m_state->stats;
+}
+} // namespace libved::ffmpeg
@@ -1,7 +1,81 @@
 #pragma once
 
+#include "file_identity.hpp"
+#include "media_info.hpp"
+#include "probe_cache.hpp"
+#include "wrappers/avformat.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace libved::ffmpeg {
+struct format_context_manager_stats {
+  // An idle, already opened context was handed out.
+  std::uint64_t hits = 0;
+  // A new context had to be opened, but the cached probe result was reused.
+  std::uint64_t probe_hits = 0;
+  // The file had to be opened and probed from scratch.
+  std::uint64_t misses = 0;
+  std::uint64_t evictions = 0;
+  std::chrono::nanoseconds total_open_time{0};
+  std::chrono::nanoseconds max_open_time{0};
+};
+
+class format_context_manager;
+
+// Exclusive use of one opened input. Every lease has its own AVFormatContext
+// and therefore its own read position. The context goes back to the manager
+// when the lease is destroyed.
+class format_context_lease {
+public:
+  format_context_lease(format_context_lease &&) = default;
+  format_context_lease &operator=(format_context_lease &&) = default;
+  ~format_context_lease();
+
+  format_context &operator*() const noexcept { return *m_context; }
+  format_context *operator->() const noexcept { return m_context.get(); }
+  [[nodiscard]] const media_info &info() const noexcept { return *m_info; }
+
+private:
+  friend class format_context_manager;
+  struct state;
+
+  format_context_lease(std::weak_ptr<state> owner, std::string path,
+                       file_identity identity,
+                       std::unique_ptr<format_context> context,
+                       std::shared_ptr<const media_info> info);
+
+  std::weak_ptr<state> m_owner;
+  std::string m_path;
+  file_identity m_identity;
+  std::unique_ptr<format_context> m_context;
+  std::shared_ptr<const media_info> m_info;
+};
+
+// Thread-safe cache of opened inputs, keyed by path and file identity
+// (so modified files are reopened). Keeps the probe result of every file it
+// has seen and a few idle contexts per file, evicting the least recently
+// used files beyond `max_entries`. With a probe_cache, files seen in earlier
+// sessions are not probed again either.
 class format_context_manager {
+public:
+  explicit format_context_manager(
+      std::size_t max_entries = 64, std::size_t max_idle_per_entry = 2,
+      std::shared_ptr<const probe_cache> disk_cache = nullptr);
+
+  [[nodiscard]] format_context_lease acquire(const char *path);
+  void clear();
+
+  [[nodiscard]] format_context_manager_stats stats() const;
 
+private:
+  std::shared_ptr<format_context_lease::state> m_state;
+  std::shared_ptr<const probe_cache> m_disk_cache;
 };
-}
+} // namespace libved::ffmpeg
@@ -0,0 +1,109 @@
+#include "media_info.hpp"
+#include <cstdint>
+#include <string_view>
+
+namespace libved::ffmpeg {
+namespace {
+// Enough for the PAT and PMT of an MPEG-TS, or the first frame of a raw
+// elementary stream.
+constexpr std::int64_t discovery_probesize = 256 * 1024;
+constexpr std::int64_t discovery_analyze_duration = AV_TIME_BASE / 10;
+
+// Header-less formats only create their streams while packets are read. The
+// cached layout is known, so probing only has to go as far as finding the
+// streams, not their parameters.
+void discover_streams(format_context &format_ctx) {
+  const auto probesize = format_ctx->probesize;
+  const auto analyze_duration = format_ctx->max_analyze_duration;
+  format_ctx->probesize = discovery_probesize;
+  format_ctx->max_analyze_duration = discovery_analyze_duration;
+  try {
+    format_ctx.find_stream_info();
+  } catch (...) {
+    format_ctx->probesize = probesize;
+    format_ctx->max_analyze_duration = analyze_duration;
+    throw;
+  }
+  format_ctx->probesize = probesize;
+  format_ctx->max_analyze_duration = analyze_duration;
+}
+} // namespace
+
+media_info media_info::capture(const format_context &format_ctx) {
+  std::string_view format_name = format_ctx->iformat->name;
+  media_info info{
+      .format_name = std::string{format_name.substr(0, format_name.find(','))},
+      .start_time = format_ctx->start_time,
+      .duration = format_ctx->duration,
+      .bit_rate = format_ctx->bit_rate,
+  };
+  info.streams.reserve(format_ctx.streams().size());
+  for (const auto *st : format_ctx.streams()) {
+    info.streams.push_back({
+        .params = copy_codec_params(*st->codecpar),
+        .time_base = st->time_base,
+        .start_time = st->start_time,
+        .duration = st->duration,
+        .nb_frames = st->nb_frames,
+        .avg_frame_rate = st->avg_frame_rate,
+        .r_frame_rate = st->r_frame_rate,
+        .sample_aspect_ratio = st->sample_aspect_ratio,
+        .disposition = st->disposition,
+    });
+  }
+  return info;
+}
+
+bool media_info::apply(format_context &format_ctx) const {
+  const auto format_streams = format_ctx.streams();
+  if (format_streams.size() != streams.size()) {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < streams.size(); ++i) {
+    const auto &cached = *streams[i].params;
+    const auto &actual = *format_streams[i]->codecpar;
+    if (cached.codec_type != actual.codec_type ||
+        cached.codec_id != actual.codec_id ||
+        av_cmp_q(streams[i].time_base, format_streams[i]->time_base) != 0) {
+      return false;
+    }
+  }
+
+  for (std::size_t i = 0; i < streams.size(); ++i) {
+    const auto &cached = streams[i];
+    auto *st = format_streams[i];
+    call_and_handle_error(
+        throw_nested_runtime_error("Unable to restore stream {} parameters", i),
+        avcodec_parameters_copy, st->codecpar, cached.params.get());
+    st->start_time = cached.start_time;
+    st->duration = cached.duration;
+    st->nb_frames = cached.nb_frames;
+    st->avg_frame_rate = cached.avg_frame_rate;
+    st->r_frame_rate = cached.r_frame_rate;
+    st->sample_aspect_ratio = cached.sample_aspect_ratio;
+    st->disposition = cached.disposition;
+  }
+  format_ctx->start_time = start_time;
+  format_ctx->duration = duration;
+  format_ctx->bit_rate = bit_rate;
+  return true;
+}
+
+const AVInputFormat *media_info::input_format() const {
+  return format_name.empty() ? nullptr
+                             : av_find_input_format(format_name.c_str());
+}
+
+tl::optional<format_context> media_info::fast_open(const char *path) const {
+  format_context format_ctx{path, probe_mode::header_only, input_format()};
+  if ((format_ctx->ctx_flags & AVFMTCTX_NOHEADER) != 0 &&
+      format_ctx.streams().size() < streams.size()) {
+    discover_streams(format_ctx);
+  }
+  if (!apply(format_ctx)) {
+    return tl::nullopt;
+  }
+  return format_ctx;
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "wrappers/avcodec.hpp"
+#include "wrappers/avformat.hpp"
+#include <cstdint>
+#include <string>
+#include <tl/optional.hpp>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct stream_info {
+  codec_params_ptr params;
+  AVRational time_base{0, 1};
+  std::int64_t start_time = AV_NOPTS_VALUE;
+  std::int64_t duration = AV_NOPTS_VALUE;
+  std::int64_t nb_frames = 0;
+  AVRational avg_frame_rate{0, 1};
+  AVRational r_frame_rate{0, 1};
+  AVRational sample_aspect_ratio{0, 1};
+  int disposition = 0;
+};
+
+// The parts of a format_context that avformat_find_stream_info computes, so
+// that a file can be reopened without probing it again.
+struct media_info {
+  // Short name of the demuxer, usable with av_find_input_format.
+  std::string format_name;
+  std::vector<stream_info> streams;
+  std::int64_t start_time = AV_NOPTS_VALUE;
+  std::int64_t duration = AV_NOPTS_VALUE;
+  std::int64_t bit_rate = 0;
+
+  [[nodiscard]] static media_info capture(const format_context &format_ctx);
+
+  // Returns false, leaving `format_ctx` untouched, if its stream layout does
+  // not match; the caller should probe it normally then.
+  bool apply(format_context &format_ctx) const;
+
+  [[nodiscard]] const AVInputFormat *input_format() const;
+
+  // Opens `path` without container format detection or full stream
+  // probing, restoring the parameters from this snapshot instead. Header-less
+  // formats are only read as far as needed to find their streams. Empty if
+  // the snapshot does not match the file anymore.
+  [[nodiscard]] tl::optional<format_context> fast_open(const char *path) const;
+};
+} // namespace libved::ffmpeg
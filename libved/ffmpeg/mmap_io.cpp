@@ -0,0 +1,75 @@
+#include "mmap_io.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+namespace libved::ffmpeg {
+mmap_io::mmap_io(const char *path, mmap_params params)
+    : io_backend{params.buffer_size, params.direct}, m_params{params},
+      m_file{path} {
+  m_file.advise(0, m_file.size(), MADV_SEQUENTIAL);
+  advise_readahead();
+}
+
+void mmap_io::advise_readahead() {
+  if (m_params.readahead == 0) {
+    return;
+  }
+
+  // Re-arm once half of the advised window has been consumed.
+  if (m_position + m_params.readahead / 2 < m_advised_until) {
+    return;
+  }
+
+  m_file.advise(m_position, m_params.readahead, MADV_WILLNEED);
+  m_advised_until = std::min(m_file.size(), m_position + m_params.readahead);
+}
+
+int mmap_io::read(std::uint8_t *buf, int buf_size) {
+  if (m_position >= m_file.size()) {
+    return AVERROR_EOF;
+  }
+
+  const auto count = std::min(static_cast<std::size_t>(buf_size),
+                              m_file.size() - m_position);
+  std::memcpy(buf, m_file.data() + m_position, count);
+  m_position += count;
+  advise_readahead();
+  return static_cast<int>(count);
+}
+
+std::int64_t mmap_io::seek(std::int64_t offset, int whence) {
+  const auto size = static_cast<std::int64_t>(m_file.size());
+  std::int64_t base = 0;
+  switch (whence & ~AVSEEK_FORCE) {
+  case AVSEEK_SIZE:
+    return size;
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = static_cast<std::int64_t>(m_position);
+    break;
+  case SEEK_END:
+    base = size;
+    break;
+  default:
+    return AVERROR(EINVAL);
+  }
+
+  const auto target = base + offset;
+  if (target < 0 || target > size) {
+    return AVERROR(EINVAL);
+  }
+
+  m_position = static_cast<std::size_t>(target);
+  m_advised_until = 0;
+  advise_readahead();
+  return target;
+}
+} // namespace libved::ffmpeg
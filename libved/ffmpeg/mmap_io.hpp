@@ -0,0 +1,37 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "wrappers/avio.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace libved::ffmpeg {
+struct mmap_params {
+  // Bytes ahead of the read position that the kernel is asked to page in.
+  std::size_t readahead = 8 << 20;
+  std::size_t buffer_size = 256 << 10;
+  // Let large reads bypass the AVIOContext buffer and copy straight from the
+  // mapping into the caller's buffer.
+  bool direct = false;
+};
+
+// Serves a local file from a read-only private mapping instead of read()
+// syscalls.
+class mmap_io : public io_backend {
+public:
+  mmap_io(const char *path, mmap_params params = {});
+
+  int read(std::uint8_t *buf, int buf_size) override;
+  std::int64_t seek(std::int64_t offset, int whence) override;
+
+  [[nodiscard]] std::size_t size() const noexcept { return m_file.size(); }
+
+private:
+  void advise_readahead();
+
+  mmap_params m_params;
+  mapped_file m_file;
+  std::size_t m_position = 0;
+  std::size_t m_advised_until = 0;
+};
+} // namespace libved::ffmpeg
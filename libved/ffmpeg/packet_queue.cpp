@@ -0,0 +1,142 @@
+#include "packet_queue.hpp"
+#include <bit>
+#include <stdexcept>
+
+namespace libved::ffmpeg {
+packet_queue::packet_queue(std::size_t capacity) {
+  if (capacity == 0) {
+    throw std::invalid_argument{"packet_queue capacity must be positive"};
+  }
+
+  m_slots.resize(std::bit_ceil(capacity));
+  m_mask = m_slots.size() - 1;
+  for (auto &slot : m_slots) {
+    slot.pkt = alloc_packet();
+  }
+}
+
+std::size_t packet_queue::size() const noexcept {
+  const auto head = m_head.load(std::memory_order_acquire);
+  const auto tail = m_tail.load(std::memory_order_acquire);
+  return tail - head;
+}
+
+queue_result packet_queue::push_slot(AVPacket *pkt, bool flush) {
+  if (is_aborted()) {
+    return queue_result::aborted;
+  }
+
+  const auto tail = m_tail.load(std::memory_order_relaxed);
+  if (tail - m_cached_head == m_slots.size()) {
+    m_cached_head = m_head.load(std::memory_order_acquire);
+    if (tail - m_cached_head == m_slots.size()) {
+      return queue_result::would_block;
+    }
+  }
+
+  auto &slot = m_slots[tail & m_mask];
+  slot.flush = flush;
+  if (pkt != nullptr) {
+    av_packet_move_ref(slot.pkt.get(), pkt);
+  }
+  m_tail.store(tail + 1, std::memory_order_release);
+  m_consumer_waiter.notify();
+  return queue_result::success;
+}
+
+queue_result packet_queue::try_push(AVPacket *pkt) {
+  return push_slot(pkt, false);
+}
+
+queue_result packet_queue::push_slot_blocking(AVPacket *pkt, bool flush) {
+  while (true) {
+    const auto result = push_slot(pkt, flush);
+    if (result != queue_result::would_block) {
+      return result;
+    }
+
+    m_producer_waiter.wait_until([this] {
+      return is_aborted() || m_tail.load(std::memory_order_relaxed) -
+                                     m_head.load(std::memory_order_acquire) <
+                                 m_slots.size();
+    });
+  }
+}
+
+queue_result packet_queue::push(AVPacket *pkt) {
+  return push_slot_blocking(pkt, false);
+}
+
+queue_result packet_queue::push_flush() {
+  m_eof.store(false, std::memory_order_release);
+  return push_slot_blocking(nullptr, true);
+}
+
+void packet_queue::finish() {
+  m_eof.store(true, std::memory_order_release);
+  m_consumer_waiter.wake();
+}
+
+queue_result packet_queue::try_pop(AVPacket *pkt) {
+  if (is_aborted()) {
+    return queue_result::aborted;
+  }
+
+  const auto head = m_head.load(std::memory_order_relaxed);
+  if (head == m_cached_tail) {
+    m_cached_tail = m_tail.load(std::memory_order_acquire);
+    if (head == m_cached_tail) {
+      if (!m_eof.load(std::memory_order_acquire)) {
+        return queue_result::would_block;
+      }
+
+      // The last packet may have been pushed right before finish().
+      m_cached_tail = m_tail.load(std::memory_order_acquire);
+      if (head == m_cached_tail) {
+        return queue_result::eof;
+      }
+    }
+  }
+
+  auto &slot = m_slots[head & m_mask];
+  const auto flush = slot.flush;
+  if (!flush) {
+    av_packet_move_ref(pkt, slot.pkt.get());
+  }
+  m_head.store(head + 1, std::memory_order_release);
+  m_producer_waiter.notify();
+  return flush ? queue_result::flush : queue_result::success;
+}
+
+queue_result packet_queue::pop(AVPacket *pkt) {
+  while (true) {
+    const auto result = try_pop(pkt);
+    if (result != queue_result::would_block) {
+      return result;
+    }
+
+    m_consumer_waiter.wait_until([this] {
+      return is_aborted() || m_eof.load(std::memory_order_acquire) ||
+             m_head.load(std::memory_order_relaxed) !=
+                 m_tail.load(std::memory_order_acquire);
+    });
+  }
+}
+
+void packet_queue::clear() {
+  const auto head = m_head.load(std::memory_order_relaxed);
+  const auto tail = m_tail.load(std::memory_order_acquire);
+  for (auto i = head; i != tail; ++i) {
+    av_packet_unref(m_slots[i & m_mask].pkt.get());
+  }
+  m_cached_tail = tail;
+  m_head.store(tail, std::memory_order_release);
+  m_producer_waiter.notify();
+}
+
+void packet_queue::abort() {
+  m_aborted.store(true, std::memory_order_release);
+  m_producer_waiter.wake();
+  m_consumer_waiter.wake();
+}
+} // namespace libved::ffmpeg
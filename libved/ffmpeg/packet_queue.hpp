@@ -1,16 +1,118 @@
 #pragma once
 
-#include <map>
-#include <queue>
-#include "wrappers/avutil.hpp"
-#include "wrappers/avformat.hpp"
+#include "wrappers/avcodec.hpp"
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 namespace libved::ffmpeg {
+inline constexpr std::size_t cache_line_size = 64;
+
+enum class queue_result {
+  success = 0,
+  flush,
+  eof,
+  would_block,
+  aborted,
+};
+
+// Parks one side of a single-producer/single-consumer structure until the
+// other side publishes something. Only pays for a futex wake when the
+// waiting side has actually gone to sleep.
+class alignas(cache_line_size) spsc_waiter {
+public:
+  template <std::predicate<> Ready> void wait_until(Ready &&ready) {
+    const auto epoch = m_epoch.load(std::memory_order_acquire);
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      m_epoch.wait(epoch, std::memory_order_acquire);
+    }
+    m_sleeping.store(false, std::memory_order_relaxed);
+  }
+
+  void notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+      wake();
+    }
+  }
+
+  void wake() {
+    m_epoch.fetch_add(1, std::memory_order_release);
+    m_epoch.notify_all();
+  }
+
+private:
+  std::atomic<std::uint32_t> m_epoch{0};
+  std::atomic<bool> m_sleeping{false};
+};
+
+// Fixed-capacity lock-free ring of refcounted packets, with exactly one
+// producer (the demuxer) and one consumer (the decoder). Slots own their
+// AVPacket structs, so pushing and popping only moves buffer references.
 class packet_queue {
 public:
-  packet_queue();
+  explicit packet_queue(std::size_t capacity = 64);
+
+  packet_queue(const packet_queue &) = delete;
+  packet_queue &operator=(const packet_queue &) = delete;
+
+  // Producer side. On success the reference held by `pkt` is moved into the
+  // queue and `pkt` is left blank.
+  queue_result try_push(AVPacket *pkt);
+  queue_result push(AVPacket *pkt);
+  // Tells the consumer to drop decoder state, e.g. after a seek.
+  queue_result push_flush();
+  // No more packets will be pushed until the next push_flush().
+  void finish();
+
+  // Consumer side. On success `pkt` receives the reference of the oldest
+  // queued packet.
+  queue_result try_pop(AVPacket *pkt);
+  queue_result pop(AVPacket *pkt);
+  // Drops every packet that is currently queued.
+  void clear();
+
+  // Either side. Wakes both sides up and makes every later call return
+  // queue_result::aborted.
+  void abort();
+
+  decltype(auto) try_push(const packet &pkt) { return try_push(pkt.get()); }
+  decltype(auto) push(const packet &pkt) { return push(pkt.get()); }
+  decltype(auto) try_pop(const packet &pkt) { return try_pop(pkt.get()); }
+  decltype(auto) pop(const packet &pkt) { return pop(pkt.get()); }
+
+  [[nodiscard]] std::size_t capacity() const noexcept { return m_slots.size(); }
+  [[nodiscard]] std::size_t size() const noexcept;
+  [[nodiscard]] bool is_aborted() const noexcept {
+    return m_aborted.load(std::memory_order_acquire);
+  }
 
 private:
-  std::queue<packet> m_queue;
+  struct slot {
+    packet pkt;
+    bool flush = false;
+  };
+
+  queue_result push_slot(AVPacket *pkt, bool flush);
+  queue_result push_slot_blocking(AVPacket *pkt, bool flush);
+
+  std::vector<slot> m_slots;
+  std::size_t m_mask;
+
+  alignas(cache_line_size) std::atomic<std::size_t> m_tail{0};
+  std::size_t m_cached_head = 0;
+
+  alignas(cache_line_size) std::atomic<std::size_t> m_head{0};
+  std::size_t m_cached_tail = 0;
+
+  alignas(cache_line_size) std::atomic<bool> m_eof{false};
+  std::atomic<bool> m_aborted{false};
+
+  spsc_waiter m_producer_waiter;
+  spsc_waiter m_consumer_waiter;
 };
 } // namespace libved::ffmpeg
@@ -0,0 +1,328 @@
+#include "pbo_readback.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace libved::vaapi {
+namespace {
+constexpr GLuint64 fence_timeout_ns = 1'000'000'000;
+
+// An RGBA8 texture and a framebuffer rendering into it.
+void make_target(int width, int height, GLuint &texture,
+                 GLuint &framebuffer) {
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         texture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    throw std::runtime_error{"Readback framebuffer is incomplete"};
+  }
+}
+
+// GL state the conversion pass changes and the caller's drawing relies on.
+class state_guard {
+public:
+  state_guard() {
+    glGetIntegerv(GL_CURRENT_PROGRAM, &m_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &m_vao);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &m_active_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &m_texture);
+  }
+
+  ~state_guard() {
+    glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(m_texture));
+    glActiveTexture(static_cast<GLenum>(m_active_texture));
+    glBindVertexArray(static_cast<GLuint>(m_vao));
+    glUseProgram(static_cast<GLuint>(m_program));
+  }
+
+  state_guard(const state_guard &) = delete;
+  state_guard &operator=(const state_guard &) = delete;
+
+private:
+  GLint m_program = 0;
+  GLint m_vao = 0;
+  GLint m_active_texture = GL_TEXTURE0;
+  GLint m_texture = 0;
+};
+} // namespace
+
+readback_frame::readback_frame(pbo_readback &owner, std::size_t slot,
+                               const std::uint8_t *data,
+                               std::uint64_t sequence)
+    : m_owner{&owner}, m_slot{slot}, m_data{data}, m_width{owner.m_width},
+      m_height{owner.m_height}, m_format{owner.m_params.format},
+      m_sequence{sequence} {}
+
+readback_frame::readback_frame(readback_frame &&other) noexcept
+    : m_owner{std::exchange(other.m_owner, nullptr)}, m_slot{other.m_slot},
+      m_data{other.m_data}, m_width{other.m_width}, m_height{other.m_height},
+      m_format{other.m_format}, m_sequence{other.m_sequence} {}
+
+readback_frame &readback_frame::operator=(readback_frame &&other) noexcept {
+  if (this != &other) {
+    if (m_owner != nullptr) {
+      m_owner->release(m_slot);
+    }
+    m_owner = std::exchange(other.m_owner, nullptr);
+    m_slot = other.m_slot;
+    m_data = other.m_data;
+    m_width = other.m_width;
+    m_height = other.m_height;
+    m_format = other.m_format;
+    m_sequence = other.m_sequence;
+  }
+  return *this;
+}
+
+readback_frame::~readback_frame() {
+  if (m_owner != nullptr) {
+    m_owner->release(m_slot);
+  }
+}
+
+std::span<const std::uint8_t> readback_frame::plane(std::size_t index) const {
+  const auto pixels = static_cast<std::size_t>(m_width) * m_height;
+  if (m_format == readback_format::rgba && index == 0) {
+    return {m_data, pixels * 4};
+  }
+  if (m_format == readback_format::nv12 && index < 2) {
+    return index == 0 ? std::span{m_data, pixels}
+                      : std::span{m_data + pixels, pixels / 2};
+  }
+  throw std::out_of_range{"No such plane in readback frame"};
+}
+
+std::size_t readback_frame::stride(std::size_t index) const {
+  const auto width = static_cast<std::size_t>(m_width);
+  if (m_format == readback_format::rgba && index == 0) {
+    return width * 4;
+  }
+  if (m_format == readback_format::nv12 && index < 2) {
+    return width;
+  }
+  throw std::out_of_range{"No such plane in readback frame"};
+}
+
+pbo_readback::pbo_readback(int width, int height, consumer deliver,
+                           readback_params params)
+    : m_width{width}, m_height{height}, m_deliver{std::move(deliver)},
+      m_params{params}, m_slots(std::max<std::size_t>(params.ring_size, 2)) {
+  const auto pixels = static_cast<std::size_t>(width) * height;
+  const bool nv12 = m_params.format == readback_format::nv12;
+  if (nv12 && (width % 4 != 0 || height % 2 != 0)) {
+    throw std::invalid_argument{
+        "nv12 readback needs a width divisible by 4 and an even height"};
+  }
+  m_size = nv12 ? pixels * 3 / 2 : pixels * 4;
+
+  m_textures.resize(nv12 ? 3 : 1);
+  m_framebuffers.resize(m_textures.size());
+  try {
+    make_target(width, height, m_textures[0], m_framebuffers[0]);
+    if (nv12) {
+      make_target(width / 4, height, m_textures[1], m_framebuffers[1]);
+      make_target(width / 4, height / 2, m_textures[2], m_framebuffers[2]);
+      m_convert = staplegl::shader_program{"rgb_to_nv12",
+                                           "./shaders/rgb_to_nv12.glsl"};
+    }
+  } catch (...) {
+    // Names not generated yet are still 0, which GL ignores.
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    delete_targets();
+    throw;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  for (auto &s : m_slots) {
+    glGenBuffers(1, &s.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(m_size),
+                 nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+pbo_readback::~pbo_readback() {
+  for (auto &s : m_slots) {
+    if (s.fence != nullptr) {
+      glDeleteSync(s.fence);
+    }
+    if (s.state == slot_state::delivered || s.state == slot_state::released) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glDeleteBuffers(1, &s.buffer);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  delete_targets();
+}
+
+void pbo_readback::delete_targets() noexcept {
+  glDeleteFramebuffers(static_cast<GLsizei>(m_framebuffers.size()),
+                       m_framebuffers.data());
+  glDeleteTextures(static_cast<GLsizei>(m_textures.size()),
+                   m_textures.data());
+}
+
+readback_stats pbo_readback::stats() const {
+  std::lock_guard lock{m_mutex};
+  return m_stats;
+}
+
+void pbo_readback::release(std::size_t index) {
+  {
+    std::lock_guard lock{m_mutex};
+    m_slots[index].state = slot_state::released;
+  }
+  m_released.notify_all();
+}
+
+void pbo_readback::reclaim() {
+  std::lock_guard lock{m_mutex};
+  for (auto &s : m_slots) {
+    if (s.state == slot_state::released) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      s.state = slot_state::free;
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool pbo_readback::deliver_next(bool wait) {
+  auto &s = m_slots[m_oldest];
+  {
+    std::lock_guard lock{m_mutex};
+    if (s.state != slot_state::pending) {
+      return false;
+    }
+  }
+
+  GLenum status = GL_TIMEOUT_EXPIRED;
+  do {
+    status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              wait ? fence_timeout_ns : 0);
+  } while (wait && status == GL_TIMEOUT_EXPIRED);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return false;
+  }
+  if (status == GL_WAIT_FAILED) {
+    throw std::runtime_error{"Waiting for a readback fence failed"};
+  }
+  glDeleteSync(s.fence);
+  s.fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+  const auto *data = static_cast<const std::uint8_t *>(
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                       static_cast<GLsizeiptr>(m_size), GL_MAP_READ_BIT));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (data == nullptr) {
+    throw std::runtime_error{"Unable to map pixel pack buffer"};
+  }
+
+  {
+    std::lock_guard lock{m_mutex};
+    s.state = slot_state::delivered;
+    ++m_stats.delivered;
+  }
+  const auto index = m_oldest;
+  m_oldest = (m_oldest + 1) % m_slots.size();
+  m_deliver(readback_frame{*this, index, data, s.sequence});
+  return true;
+}
+
+void pbo_readback::convert(GLuint framebuffer) {
+  // Flipping while copying makes the rows come back top to bottom.
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffers[0]);
+  glBlitFramebuffer(0, 0, m_width, m_height, 0, m_height, m_width, 0,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  if (m_params.format != readback_format::nv12) {
+    return;
+  }
+
+  state_guard guard;
+  m_convert.bind();
+  m_vao.bind();
+  glBindTexture(GL_TEXTURE_2D, m_textures[0]);
+  for (int plane = 0; plane < 2; ++plane) {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffers[1 + plane]);
+    glViewport(0, 0, m_width / 4, plane == 0 ? m_height : m_height / 2);
+    m_convert.upload_uniform1i("plane", plane);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+}
+
+void pbo_readback::capture(GLuint framebuffer) {
+  reclaim();
+  while (deliver_next(false)) {
+  }
+
+  // The ring has come around to a frame that is still in flight.
+  auto &s = m_slots[m_next];
+  bool stalled = false;
+  {
+    std::lock_guard lock{m_mutex};
+    stalled = s.state == slot_state::pending;
+  }
+  if (stalled) {
+    deliver_next(true);
+  }
+  {
+    std::unique_lock lock{m_mutex};
+    if (s.state == slot_state::delivered) {
+      stalled = true;
+      m_released.wait(lock, [&] { return s.state != slot_state::delivered; });
+    }
+  }
+  reclaim();
+
+  convert(framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+  if (m_params.format == readback_format::nv12) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffers[1]);
+    glReadPixels(0, 0, m_width / 4, m_height, GL_RGBA, GL_UNSIGNED_BYTE,
+                 nullptr);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffers[2]);
+    glReadPixels(0, 0, m_width / 4, m_height / 2, GL_RGBA, GL_UNSIGNED_BYTE,
+                 reinterpret_cast<void *>(static_cast<std::uintptr_t>(
+                     static_cast<std::size_t>(m_width) * m_height)));
+  } else {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffers[0]);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, m_width, m_height);
+  {
+    std::lock_guard lock{m_mutex};
+    s.state = slot_state::pending;
+    s.sequence = m_stats.captured++;
+    if (stalled) {
+      ++m_stats.stalls;
+    }
+  }
+  m_next = (m_next + 1) % m_slots.size();
+}
+
+void pbo_readback::flush() {
+  reclaim();
+  while (deliver_next(true)) {
+  }
+}
+} // namespace libved::vaapi
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "glad/gles2.h"
+#include "staplegl.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace libved::vaapi {
+enum class readback_format {
+  // Tightly packed RGBA rows.
+  rgba,
+  // A full-size luma plane followed by a half-size interleaved chroma plane,
+  // BT.709 limited range: 1.5 bytes per pixel instead of 4.
+  nv12,
+};
+
+struct readback_params {
+  // Frames in flight between the GPU and the consumer.
+  std::size_t ring_size = 3;
+  readback_format format = readback_format::rgba;
+};
+
+struct readback_stats {
+  std::uint64_t captured = 0;
+  std::uint64_t delivered = 0;
+  // Captures that had to wait, for the GPU to finish an older frame or for
+  // a consumer to release one.
+  std::uint64_t stalls = 0;
+};
+
+class pbo_readback;
+
+// A read back frame, viewed straight in a mapped pixel-pack buffer. Rows are
+// top to bottom. The buffer is handed back to the pbo_readback when the
+// frame is destroyed, which may happen on any thread, but before the
+// pbo_readback itself is.
+class readback_frame {
+public:
+  readback_frame(readback_frame &&other) noexcept;
+  readback_frame &operator=(readback_frame &&other) noexcept;
+  readback_frame(const readback_frame &) = delete;
+  readback_frame &operator=(const readback_frame &) = delete;
+  ~readback_frame();
+
+  [[nodiscard]] int width() const noexcept { return m_width; }
+  [[nodiscard]] int height() const noexcept { return m_height; }
+  [[nodiscard]] readback_format format() const noexcept { return m_format; }
+  // Position of the frame among every frame captured.
+  [[nodiscard]] std::uint64_t sequence() const noexcept { return m_sequence; }
+
+  // Plane 0 holds RGBA or luma, plane 1 the chroma of nv12 frames.
+  [[nodiscard]] std::span<const std::uint8_t> plane(std::size_t index) const;
+  [[nodiscard]] std::size_t stride(std::size_t index) const;
+
+private:
+  friend class pbo_readback;
+  readback_frame(pbo_readback &owner, std::size_t slot,
+                 const std::uint8_t *data, std::uint64_t sequence);
+
+  pbo_readback *m_owner;
+  std::size_t m_slot;
+  const std::uint8_t *m_data;
+  int m_width;
+  int m_height;
+  readback_format m_format;
+  std::uint64_t m_sequence;
+};
+
+// Reads rendered frames back through a ring of pixel-pack buffers, so that
+// the transfer of frame N overlaps the rendering of the frames after it
+// instead of stalling like a plain glReadPixels. Each capture is fenced and
+// delivered to the consumer once the fence has signalled, mapped rather than
+// copied. With readback_format::nv12 the frame is converted by a shader
+// first, so less than half the bytes cross the bus.
+class pbo_readback {
+public:
+  // Called on the GL thread, from capture() and flush(), in capture order.
+  using consumer = std::function<void(readback_frame)>;
+
+  // nv12 needs a width that is a multiple of 4 and an even height.
+  pbo_readback(int width, int height, consumer deliver,
+               readback_params params = {});
+  ~pbo_readback();
+
+  pbo_readback(const pbo_readback &) = delete;
+  pbo_readback &operator=(const pbo_readback &) = delete;
+
+  // Must be called with the context current, after the frame has been
+  // drawn into `framebuffer`. Delivers every earlier frame that is ready.
+  void capture(GLuint framebuffer);
+  // Waits for and delivers every captured frame.
+  void flush();
+
+  [[nodiscard]] readback_stats stats() const;
+  [[nodiscard]] std::size_t frame_size() const noexcept { return m_size; }
+
+private:
+  friend class readback_frame;
+
+  enum class slot_state {
+    free,
+    pending,
+    delivered,
+    released,
+  };
+
+  struct slot {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    std::uint64_t sequence = 0;
+    slot_state state = slot_state::free;
+  };
+
+  void release(std::size_t index);
+  // Unmaps the buffers consumers are done with.
+  void reclaim();
+  // Delivers the oldest pending frame; returns false if there is none or,
+  // unless `wait`, it is not ready yet.
+  bool deliver_next(bool wait);
+  void convert(GLuint framebuffer);
+  void delete_targets() noexcept;
+
+  int m_width;
+  int m_height;
+  consumer m_deliver;
+  readback_params m_params;
+  std::size_t m_size;
+
+  staplegl::shader_program m_convert;
+  staplegl::vertex_array m_vao;
+  // Top-down RGBA copy of the captured frame, and for nv12 the packed luma
+  // and chroma planes rendered from it.
+  std::vector<GLuint> m_textures;
+  std::vector<GLuint> m_framebuffers;
+
+  std::vector<slot> m_slots;
+  std::size_t m_next = 0;
+  std::size_t m_oldest = 0;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_released;
+  readback_stats m_stats;
+};
+} // namespace libved::vaapi
@@ -0,0 +1,190 @@
+#include "pbo_uploader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fmt/core.h>
+#include <stdexcept>
+
+namespace libved::vaapi {
+namespace {
+constexpr GLuint64 fence_timeout_ns = 1'000'000'000;
+
+int chroma_size(int size) { return (size + 1) / 2; }
+
+// P010 keeps its 10 bits in the high bits of each sample; the top byte is a
+// limited-range 8-bit sample, which is what the shader expects.
+void copy_high_bytes(std::uint8_t *dst, const std::uint8_t *src,
+                     std::size_t samples) {
+  const auto *src16 = reinterpret_cast<const std::uint16_t *>(src);
+  for (std::size_t i = 0; i < samples; ++i) {
+    dst[i] = static_cast<std::uint8_t>(src16[i] >> 8);
+  }
+}
+
+void interleave(std::uint8_t *dst, const std::uint8_t *u, const std::uint8_t *v,
+                std::size_t samples) {
+  for (std::size_t i = 0; i < samples; ++i) {
+    dst[2 * i] = u[i];
+    dst[2 * i + 1] = v[i];
+  }
+}
+
+void fill_buffer(std::uint8_t *dst, const AVFrame &frame) {
+  const auto width = static_cast<std::size_t>(frame.width);
+  const auto cwidth = static_cast<std::size_t>(chroma_size(frame.width));
+  const auto cheight = chroma_size(frame.height);
+  const auto format = static_cast<AVPixelFormat>(frame.format);
+
+  for (int y = 0; y < frame.height; ++y) {
+    const auto *src = frame.data[0] + static_cast<std::ptrdiff_t>(y) *
+                                          frame.linesize[0];
+    if (format == AV_PIX_FMT_P010) {
+      copy_high_bytes(dst, src, width);
+    } else {
+      std::memcpy(dst, src, width);
+    }
+    dst += width;
+  }
+
+  for (int y = 0; y < cheight; ++y) {
+    const auto row = [&](int plane) {
+      return frame.data[plane] +
+             static_cast<std::ptrdiff_t>(y) * frame.linesize[plane];
+    };
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+      interleave(dst, row(1), row(2), cwidth);
+      break;
+    case AV_PIX_FMT_P010:
+      copy_high_bytes(dst, row(1), cwidth * 2);
+      break;
+    default:
+      std::memcpy(dst, row(1), cwidth * 2);
+      break;
+    }
+    dst += cwidth * 2;
+  }
+}
+
+void wait_and_delete(GLsync &fence) {
+  if (fence == nullptr) {
+    return;
+  }
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                          fence_timeout_ns) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+staplegl::texture_2d make_texture(int width, int height,
+                                  staplegl::texture_color color) {
+  return staplegl::texture_2d{{},
+                              staplegl::resolution{width, height},
+                              color,
+                              {
+                                  .min_filter = GL_LINEAR,
+                                  .mag_filter = GL_LINEAR,
+                                  .clamping = GL_CLAMP_TO_EDGE,
+                              },
+                              staplegl::tex_samples::MSAA_X1,
+                              false,
+                              true};
+}
+} // namespace
+
+pbo_uploader::pbo_uploader(std::size_t ring_size)
+    : m_slots(std::max<std::size_t>(ring_size, 2)) {
+  for (auto &s : m_slots) {
+    glGenBuffers(1, &s.buffer);
+  }
+}
+
+pbo_uploader::~pbo_uploader() {
+  for (auto &s : m_slots) {
+    if (s.fence != nullptr) {
+      glDeleteSync(s.fence);
+    }
+    glDeleteBuffers(1, &s.buffer);
+  }
+}
+
+bool pbo_uploader::supports(AVPixelFormat format) noexcept {
+  return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_NV12 ||
+         format == AV_PIX_FMT_P010;
+}
+
+void pbo_uploader::prepare(slot &s, int width, int height) {
+  const auto size =
+      static_cast<std::size_t>(width) * height +
+      static_cast<std::size_t>(chroma_size(width)) * chroma_size(height) * 2;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+  if (s.buffer_size != size) {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(size),
+                 nullptr, GL_STREAM_DRAW);
+    s.buffer_size = size;
+  }
+  if (s.width == width && s.height == height) {
+    return;
+  }
+
+  // Texture storage must not be initialised from the bound buffer.
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  // texture_2d's move assignment does not delete the texture it replaces.
+  for (const auto &texture : s.textures) {
+    if (const GLuint id = texture.id(); id != 0) {
+      glDeleteTextures(1, &id);
+    }
+  }
+  s.textures[0] =
+      make_texture(width, height, {GL_R8, GL_RED, GL_UNSIGNED_BYTE});
+  s.textures[1] = make_texture(chroma_size(width), chroma_size(height),
+                               {GL_RG8, GL_RG, GL_UNSIGNED_BYTE});
+  s.width = width;
+  s.height = height;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+}
+
+uploaded_texture pbo_uploader::upload(const AVFrame &frame) {
+  if (!supports(static_cast<AVPixelFormat>(frame.format))) {
+    throw std::runtime_error{
+        fmt::format("Unsupported upload pixel format {}", frame.format)};
+  }
+
+  // Covers both the upload into and the draws from the previous slot.
+  if (m_last != nullptr) {
+    m_last->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  auto &s = m_slots[m_next];
+  m_next = (m_next + 1) % m_slots.size();
+  wait_and_delete(s.fence);
+  prepare(s, frame.width, frame.height);
+
+  auto *mapped = static_cast<std::uint8_t *>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(s.buffer_size),
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT));
+  if (mapped == nullptr) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    throw std::runtime_error{"Unable to map pixel unpack buffer"};
+  }
+  fill_buffer(mapped, frame);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  s.textures[0].bind();
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_RED,
+                  GL_UNSIGNED_BYTE, nullptr);
+  s.textures[1].bind();
+  glTexSubImage2D(
+      GL_TEXTURE_2D, 0, 0, 0, chroma_size(frame.width),
+      chroma_size(frame.height), GL_RG, GL_UNSIGNED_BYTE,
+      reinterpret_cast<const void *>(static_cast<std::uintptr_t>(
+          static_cast<std::size_t>(frame.width) * frame.height)));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  m_last = &s;
+  return {s.textures[0], s.textures[1]};
+}
+} // namespace libved::vaapi
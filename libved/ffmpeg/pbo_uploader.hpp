@@ -0,0 +1,69 @@
+#pragma once
+
+#include "glad/gles2.h"
+#include "staplegl.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+namespace libved::vaapi {
+// A software frame uploaded by a pbo_uploader, as a luma and an interleaved
+// chroma texture like nv12_texture. The textures belong to the uploader and
+// are reused once it has gone around its ring.
+class uploaded_texture {
+public:
+  uploaded_texture(staplegl::texture_2d &luma, staplegl::texture_2d &chroma)
+      : m_textures{&luma, &chroma} {}
+
+  void bind_units(std::uint32_t luma, std::uint32_t chroma) {
+    m_textures[0]->set_unit(luma);
+    m_textures[1]->set_unit(chroma);
+  }
+
+private:
+  std::array<staplegl::texture_2d *, 2> m_textures;
+};
+
+// Streams software-decoded yuv420p, nv12 and p010 frames to textures through
+// a ring of pixel-unpack buffers. Each slot has its own buffer and textures
+// and is fenced after the frame drawn from it, so filling the buffer for
+// frame N never waits for the GPU to finish with frame N-1.
+//
+// Only needs OpenGL ES 3.0, so it also runs on llvmpipe.
+class pbo_uploader {
+public:
+  explicit pbo_uploader(std::size_t ring_size = 3);
+  ~pbo_uploader();
+
+  pbo_uploader(const pbo_uploader &) = delete;
+  pbo_uploader &operator=(const pbo_uploader &) = delete;
+
+  [[nodiscard]] static bool supports(AVPixelFormat format) noexcept;
+
+  // Must be called with the context current, once per displayed frame,
+  // after everything drawn from the previous upload has been submitted.
+  [[nodiscard]] uploaded_texture upload(const AVFrame &frame);
+
+private:
+  struct slot {
+    GLuint buffer = 0;
+    std::size_t buffer_size = 0;
+    GLsync fence = nullptr;
+    int width = 0;
+    int height = 0;
+    std::array<staplegl::texture_2d, 2> textures;
+  };
+
+  void prepare(slot &s, int width, int height);
+
+  std::vector<slot> m_slots;
+  std::size_t m_next = 0;
+  slot *m_last = nullptr;
+};
+} // namespace libved::vaapi
@@ -0,0 +1,263 @@
+#include "pools.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+}
+
+namespace libved::ffmpeg {
+namespace {
+constexpr int plane_alignment = 64;
+constexpr std::size_t max_buffer_pools = 16;
+
+struct buffer_pool_deleter {
+  void operator()(AVBufferPool *p) { av_buffer_pool_uninit(&p); }
+};
+
+using buffer_pool = std::unique_ptr<AVBufferPool, buffer_pool_deleter>;
+
+template <typename T> struct object_traits;
+
+template <> struct object_traits<AVFrame> {
+  static AVFrame *alloc() { return av_frame_alloc(); }
+  static void free(AVFrame *f) { av_frame_free(&f); }
+  static void unref(AVFrame *f) { av_frame_unref(f); }
+};
+
+template <> struct object_traits<AVPacket> {
+  static AVPacket *alloc() { return av_packet_alloc(); }
+  static void free(AVPacket *p) { av_packet_free(&p); }
+  static void unref(AVPacket *p) { av_packet_unref(p); }
+};
+
+template <typename T> class object_pool : public recycler<T> {
+public:
+  using traits = object_traits<T>;
+
+  explicit object_pool(std::size_t max_idle) : m_max_idle{max_idle} {}
+
+  ~object_pool() override {
+    for (auto *object : m_idle) {
+      traits::free(object);
+    }
+  }
+
+  T *take() {
+    {
+      std::lock_guard lock{m_mutex};
+      if (!m_idle.empty()) {
+        auto *object = m_idle.back();
+        m_idle.pop_back();
+        m_reuses.fetch_add(1, std::memory_order_relaxed);
+        return object;
+      }
+    }
+
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    return call_alloc(throw_nested_runtime_error("Unable to allocate pooled "
+                                                 "object"),
+                      traits::alloc);
+  }
+
+  void recycle(T *object) noexcept override {
+    traits::unref(object);
+    {
+      std::lock_guard lock{m_mutex};
+      if (m_idle.size() < m_max_idle) {
+        m_idle.push_back(object);
+        return;
+      }
+    }
+    traits::free(object);
+  }
+
+  // Called by AVBufferPool when it has no free buffer left.
+  static AVBufferRef *alloc_buffer(void *opaque, std::size_t size) {
+    static_cast<object_pool *>(opaque)->m_buffer_allocations.fetch_add(
+        1, std::memory_order_relaxed);
+    return av_buffer_alloc(size);
+  }
+
+  AVBufferRef *get_buffer(AVBufferPool *pool) {
+    m_buffer_requests.fetch_add(1, std::memory_order_relaxed);
+    return call_alloc(throw_nested_runtime_error("Unable to allocate pooled "
+                                                 "buffer"),
+                      av_buffer_pool_get, pool);
+  }
+
+  pool_stats stats() const {
+    return {
+        .allocations = m_allocations.load(std::memory_order_relaxed),
+        .reuses = m_reuses.load(std::memory_order_relaxed),
+        .buffer_allocations =
+            m_buffer_allocations.load(std::memory_order_relaxed),
+        .buffer_requests = m_buffer_requests.load(std::memory_order_relaxed),
+    };
+  }
+
+  std::mutex m_mutex;
+
+private:
+  std::size_t m_max_idle;
+  std::vector<T *> m_idle;
+  std::atomic<std::uint64_t> m_allocations{0};
+  std::atomic<std::uint64_t> m_reuses{0};
+  std::atomic<std::uint64_t> m_buffer_allocations{0};
+  std::atomic<std::uint64_t> m_buffer_requests{0};
+};
+
+struct image_layout {
+  int linesizes[4]{};
+  std::size_t plane_sizes[4]{};
+  std::size_t total_size = 0;
+};
+
+image_layout layout_of(int width, int height, AVPixelFormat format) {
+  image_layout layout;
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to compute frame linesizes"),
+      av_image_fill_linesizes, layout.linesizes, format, width);
+
+  ptrdiff_t linesizes[4];
+  for (int i = 0; i < 4; ++i) {
+    // Every row starts aligned, which also satisfies any decoder's stride
+    // alignment and GL_UNPACK_ALIGNMENT.
+    layout.linesizes[i] = (layout.linesizes[i] + plane_alignment - 1) /
+                          plane_alignment * plane_alignment;
+    linesizes[i] = layout.linesizes[i];
+  }
+  const int ret = av_image_fill_plane_sizes(layout.plane_sizes, format, height,
+                                            linesizes);
+  check_error(throw_nested_runtime_error("Unable to compute frame plane sizes"),
+              ret < 0 ? ret : 0);
+
+  for (auto &size : layout.plane_sizes) {
+    // Keep every plane start aligned as well.
+    size = (size + plane_alignment - 1) / plane_alignment * plane_alignment;
+    layout.total_size += size;
+  }
+  // SIMD code may read a little past the end of the last plane.
+  layout.total_size += plane_alignment;
+  return layout;
+}
+} // namespace
+
+class frame_pool::state : public object_pool<AVFrame> {
+public:
+  using object_pool::object_pool;
+
+  using key = std::tuple<int, int, int>;
+  struct geometry {
+    image_layout layout;
+    buffer_pool pool;
+  };
+
+  // Guarded by m_mutex.
+  std::map<key, geometry> geometries;
+};
+
+frame_pool::frame_pool(std::size_t max_idle)
+    : m_state{std::make_shared<state>(max_idle)} {}
+
+frame frame_pool::get() { return {m_state->take(), m_state}; }
+
+void frame_pool::allocate_buffers(AVFrame *frm, int width, int height) {
+  const auto format = static_cast<AVPixelFormat>(frm->format);
+  AVBufferPool *pool = nullptr;
+  image_layout layout;
+  {
+    std::lock_guard lock{m_state->m_mutex};
+    auto &geometries = m_state->geometries;
+    const state::key key{width, height, format};
+    auto it = geometries.find(key);
+    if (it == geometries.end()) {
+      // Pools of geometries no longer in use are freed once their
+      // outstanding buffers come back.
+      if (geometries.size() >= max_buffer_pools) {
+        geometries.clear();
+      }
+      auto new_layout = layout_of(width, height, format);
+      buffer_pool new_pool{av_buffer_pool_init2(new_layout.total_size,
+                                                m_state.get(),
+                                                &state::alloc_buffer, nullptr)};
+      if (new_pool == nullptr) {
+        throw std::bad_alloc{};
+      }
+      it = geometries
+               .emplace(key, state::geometry{new_layout, std::move(new_pool)})
+               .first;
+    }
+    pool = it->second.pool.get();
+    layout = it->second.layout;
+  }
+
+  frm->buf[0] = m_state->get_buffer(pool);
+  auto *data = frm->buf[0]->data;
+  for (int i = 0; i < 4 && layout.plane_sizes[i] != 0; ++i) {
+    frm->data[i] = data;
+    frm->linesize[i] = layout.linesizes[i];
+    data += layout.plane_sizes[i];
+  }
+  frm->extended_data = frm->data;
+}
+
+frame frame_pool::get(int width, int height, AVPixelFormat format) {
+  auto result = get();
+  result->width = width;
+  result->height = height;
+  result->format = format;
+  allocate_buffers(result.get(), width, height);
+  return result;
+}
+
+pool_stats frame_pool::stats() const { return m_state->stats(); }
+
+class packet_pool::state : public object_pool<AVPacket> {
+public:
+  using object_pool::object_pool;
+
+  // Indexed by log2 of the payload size class. Guarded by m_mutex.
+  std::map<int, buffer_pool> size_classes;
+};
+
+packet_pool::packet_pool(std::size_t max_idle)
+    : m_state{std::make_shared<state>(max_idle)} {}
+
+packet packet_pool::get() { return {m_state->take(), m_state}; }
+
+packet packet_pool::get(std::size_t size) {
+  const auto capacity = std::bit_ceil(
+      std::max<std::size_t>(size + AV_INPUT_BUFFER_PADDING_SIZE, 4096));
+  const auto size_class = std::countr_zero(capacity);
+  AVBufferPool *pool = nullptr;
+  {
+    std::lock_guard lock{m_state->m_mutex};
+    auto &entry = m_state->size_classes[size_class];
+    if (entry == nullptr) {
+      entry.reset(av_buffer_pool_init2(capacity, m_state.get(),
+                                       &state::alloc_buffer, nullptr));
+      if (entry == nullptr) {
+        throw std::bad_alloc{};
+      }
+    }
+    pool = entry.get();
+  }
+
+  auto result = get();
+  result->buf = m_state->get_buffer(pool);
+  result->data = result->buf->data;
+  result->size = static_cast<int>(size);
+  std::memset(result->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+  return result;
+}
+
+pool_stats packet_pool::stats() const { return m_state->stats(); }
+} // namespace libved::ffmpeg
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "wrappers/avcodec.hpp"
+#include "wrappers/avutil.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace libved::ffmpeg {
+struct pool_stats {
+  // AVFrame/AVPacket structs that had to be allocated.
+  std::uint64_t allocations = 0;
+  // Structs handed out again after being recycled.
+  std::uint64_t reuses = 0;
+  // Payload buffers that had to be allocated.
+  std::uint64_t buffer_allocations = 0;
+  // Payload buffers handed out from a buffer pool.
+  std::uint64_t buffer_requests = 0;
+};
+
+// Hands out frames whose structs go back to the pool, unreferenced, when the
+// frame handle is destroyed. Payloads obtained through get(width, ...) come
+// from AVBufferPools and are recycled when their last reference goes away.
+class frame_pool {
+public:
+  explicit frame_pool(std::size_t max_idle = 32);
+
+  [[nodiscard]] frame get();
+  // A frame with writable, 64-byte aligned planes.
+  [[nodiscard]] frame get(int width, int height, AVPixelFormat format);
+  // Gives `frm` pooled planes for its format, laid out for a picture of
+  // `width` x `height`, which may be larger than the frame itself when a
+  // decoder needs padding.
+  void allocate_buffers(AVFrame *frm, int width, int height);
+
+  [[nodiscard]] pool_stats stats() const;
+
+  class state;
+
+private:
+  std::shared_ptr<state> m_state;
+};
+
+class packet_pool {
+public:
+  explicit packet_pool(std::size_t max_idle = 256);
+
+  [[nodiscard]] packet get();
+  // A packet with a writable payload of `size` bytes plus zeroed padding.
+  [[nodiscard]] packet get(std::size_t size);
+
+  [[nodiscard]] pool_stats stats() const;
+
+  class state;
+
+private:
+  std::shared_ptr<state> m_state;
+};
+} // namespace libved::ffmpeg
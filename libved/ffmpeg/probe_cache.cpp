@@ -0,0 +1,295 @@
+#include "probe_cache.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <errors.hpp>
+#include <spdlog/spdlog.h>
+#include <string_view>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+}
+
+namespace libved::ffmpeg {
+namespace {
+constexpr std::uint32_t probe_cache_magic = 0x4350564c; // "LVPC"
+constexpr std::uint32_t probe_cache_version = 1;
+
+struct probe_cache_header {
+  std::uint32_t magic = probe_cache_magic;
+  std::uint32_t version = probe_cache_version;
+  std::uint32_t avformat_version = LIBAVFORMAT_VERSION_INT;
+  std::uint32_t avcodec_version = LIBAVCODEC_VERSION_INT;
+  file_identity identity;
+};
+
+struct stream_record {
+  AVRational time_base;
+  std::int64_t start_time;
+  std::int64_t duration;
+  std::int64_t nb_frames;
+  AVRational avg_frame_rate;
+  AVRational r_frame_rate;
+  AVRational sample_aspect_ratio;
+  std::int32_t disposition;
+};
+
+struct codec_params_record {
+  std::int32_t codec_type;
+  std::int32_t codec_id;
+  std::uint32_t codec_tag;
+  std::int32_t format;
+  std::int64_t bit_rate;
+  std::int32_t bits_per_coded_sample;
+  std::int32_t bits_per_raw_sample;
+  std::int32_t profile;
+  std::int32_t level;
+  std::int32_t width;
+  std::int32_t height;
+  AVRational sample_aspect_ratio;
+  AVRational framerate;
+  std::int32_t field_order;
+  std::int32_t color_range;
+  std::int32_t color_primaries;
+  std::int32_t color_trc;
+  std::int32_t color_space;
+  std::int32_t chroma_location;
+  std::int32_t video_delay;
+  std::int32_t ch_order;
+  std::int32_t nb_channels;
+  std::uint64_t ch_mask;
+  std::int32_t sample_rate;
+  std::int32_t block_align;
+  std::int32_t frame_size;
+  std::int32_t initial_padding;
+  std::int32_t trailing_padding;
+  std::int32_t seek_preroll;
+  std::int32_t extradata_size;
+};
+
+template <typename T> void assign(T &field, std::int64_t value) {
+  field = static_cast<T>(value);
+}
+
+bool write_codec_params(byte_writer &writer, const codec_params &p) {
+  // Custom and ambisonic layouts carry a channel map we do not serialise.
+  if (p.ch_layout.order != AV_CHANNEL_ORDER_UNSPEC &&
+      p.ch_layout.order != AV_CHANNEL_ORDER_NATIVE) {
+    return false;
+  }
+
+  writer.write(codec_params_record{
+      .codec_type = static_cast<std::int32_t>(p.codec_type),
+      .codec_id = static_cast<std::int32_t>(p.codec_id),
+      .codec_tag = p.codec_tag,
+      .format = p.format,
+      .bit_rate = p.bit_rate,
+      .bits_per_coded_sample = p.bits_per_coded_sample,
+      .bits_per_raw_sample = p.bits_per_raw_sample,
+      .profile = p.profile,
+      .level = p.level,
+      .width = p.width,
+      .height = p.height,
+      .sample_aspect_ratio = p.sample_aspect_ratio,
+      .framerate = p.framerate,
+      .field_order = static_cast<std::int32_t>(p.field_order),
+      .color_range = static_cast<std::int32_t>(p.color_range),
+      .color_primaries = static_cast<std::int32_t>(p.color_primaries),
+      .color_trc = static_cast<std::int32_t>(p.color_trc),
+      .color_space = static_cast<std::int32_t>(p.color_space),
+      .chroma_location = static_cast<std::int32_t>(p.chroma_location),
+      .video_delay = p.video_delay,
+      .ch_order = static_cast<std::int32_t>(p.ch_layout.order),
+      .nb_channels = p.ch_layout.nb_channels,
+      .ch_mask = p.ch_layout.order == AV_CHANNEL_ORDER_NATIVE
+                     ? p.ch_layout.u.mask
+                     : 0,
+      .sample_rate = p.sample_rate,
+      .block_align = p.block_align,
+      .frame_size = p.frame_size,
+      .initial_padding = p.initial_padding,
+      .trailing_padding = p.trailing_padding,
+      .seek_preroll = p.seek_preroll,
+      .extradata_size = p.extradata_size,
+  });
+  writer.write_bytes(std::as_bytes(std::span{
+      p.extradata, static_cast<std::size_t>(std::max(p.extradata_size, 0))}));
+  return true;
+}
+
+tl::optional<codec_params_ptr> read_codec_params(byte_reader &reader) {
+  codec_params_record r{};
+  if (!reader.read(r) || r.extradata_size < 0) {
+    return tl::nullopt;
+  }
+  const auto extradata =
+      reader.read_bytes(static_cast<std::size_t>(r.extradata_size));
+  if (!extradata.has_value()) {
+    return tl::nullopt;
+  }
+
+  auto params = alloc_codec_params();
+  auto &p = *params;
+  assign(p.codec_type, r.codec_type);
+  assign(p.codec_id, r.codec_id);
+  p.codec_tag = r.codec_tag;
+  p.format = r.format;
+  p.bit_rate = r.bit_rate;
+  p.bits_per_coded_sample = r.bits_per_coded_sample;
+  p.bits_per_raw_sample = r.bits_per_raw_sample;
+  p.profile = r.profile;
+  p.level = r.level;
+  p.width = r.width;
+  p.height = r.height;
+  p.sample_aspect_ratio = r.sample_aspect_ratio;
+  p.framerate = r.framerate;
+  assign(p.field_order, r.field_order);
+  assign(p.color_range, r.color_range);
+  assign(p.color_primaries, r.color_primaries);
+  assign(p.color_trc, r.color_trc);
+  assign(p.color_space, r.color_space);
+  assign(p.chroma_location, r.chroma_location);
+  p.video_delay = r.video_delay;
+  if (r.ch_order == AV_CHANNEL_ORDER_NATIVE) {
+    av_channel_layout_from_mask(&p.ch_layout, r.ch_mask);
+  } else {
+    assign(p.ch_layout.order, AV_CHANNEL_ORDER_UNSPEC);
+    p.ch_layout.nb_channels = r.nb_channels;
+  }
+  p.sample_rate = r.sample_rate;
+  p.block_align = r.block_align;
+  p.frame_size = r.frame_size;
+  p.initial_padding = r.initial_padding;
+  p.trailing_padding = r.trailing_padding;
+  p.seek_preroll = r.seek_preroll;
+
+  if (!extradata->empty()) {
+    p.extradata = static_cast<std::uint8_t *>(call_alloc(
+        throw_nested_runtime_error("Unable to allocate codec extradata"),
+        av_mallocz, extradata->size() + AV_INPUT_BUFFER_PADDING_SIZE));
+    std::memcpy(p.extradata, extradata->data(), extradata->size());
+    p.extradata_size = r.extradata_size;
+  }
+  return params;
+}
+} // namespace
+
+probe_cache::probe_cache(std::filesystem::path directory)
+    : m_directory{std::move(directory)} {}
+
+std::filesystem::path
+probe_cache::entry_path(const file_identity &identity) const {
+  return m_directory / (identity.to_string() + ".probe");
+}
+
+tl::optional<media_info>
+probe_cache::load(const file_identity &identity) const {
+  const auto data = read_file(entry_path(identity));
+  if (!data.has_value()) {
+    return tl::nullopt;
+  }
+
+  byte_reader reader{*data};
+  probe_cache_header header;
+  const probe_cache_header expected{.identity = identity};
+  std::uint32_t name_size = 0;
+  std::uint32_t stream_count = 0;
+  media_info info;
+  if (!reader.read(header) || header.magic != expected.magic ||
+      header.version != expected.version ||
+      header.avformat_version != expected.avformat_version ||
+      header.avcodec_version != expected.avcodec_version ||
+      header.identity != identity || !reader.read(name_size)) {
+    return tl::nullopt;
+  }
+
+  const auto name = reader.read_bytes(name_size);
+  if (!name.has_value() || !reader.read(info.start_time) ||
+      !reader.read(info.duration) || !reader.read(info.bit_rate) ||
+      !reader.read(stream_count)) {
+    return tl::nullopt;
+  }
+  info.format_name.assign(reinterpret_cast<const char *>(name->data()),
+                          name->size());
+
+  for (std::uint32_t i = 0; i < stream_count; ++i) {
+    stream_record r{};
+    if (!reader.read(r)) {
+      return tl::nullopt;
+    }
+    auto params = read_codec_params(reader);
+    if (!params.has_value()) {
+      return tl::nullopt;
+    }
+    info.streams.push_back({
+        .params = std::move(*params),
+        .time_base = r.time_base,
+        .start_time = r.start_time,
+        .duration = r.duration,
+        .nb_frames = r.nb_frames,
+        .avg_frame_rate = r.avg_frame_rate,
+        .r_frame_rate = r.r_frame_rate,
+        .sample_aspect_ratio = r.sample_aspect_ratio,
+        .disposition = r.disposition,
+    });
+  }
+
+  if (!reader.empty()) {
+    return tl::nullopt;
+  }
+  return info;
+}
+
+void probe_cache::store(const file_identity &identity,
+                        const media_info &info) const {
+  byte_writer writer;
+  writer.write(probe_cache_header{.identity = identity});
+  writer.write(static_cast<std::uint32_t>(info.format_name.size()));
+  writer.write_bytes(std::as_bytes(std::span{info.format_name}));
+  writer.write(info.start_time);
+  writer.write(info.duration);
+  writer.write(info.bit_rate);
+  writer.write(static_cast<std::uint32_t>(info.streams.size()));
+  for (const auto &st : info.streams) {
+    writer.write(stream_record{
+        .time_base = st.time_base,
+        .start_time = st.start_time,
+        .duration = st.duration,
+        .nb_frames = st.nb_frames,
+        .avg_frame_rate = st.avg_frame_rate,
+        .r_frame_rate = st.r_frame_rate,
+        .sample_aspect_ratio = st.sample_aspect_ratio,
+        .disposition = st.disposition,
+    });
+    if (!write_codec_params(writer, *st.params)) {
+      spdlog::debug("Not caching probe result with custom channel layout");
+      return;
+    }
+  }
+
+  try {
+    write_file_atomic(entry_path(identity), writer.data());
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+}
+
+probed_input probe_cache::open(const char *path,
+                               const file_identity &identity) const {
+  if (auto info = load(identity); info.has_value()) {
+    auto shared = std::make_shared<const media_info>(std::move(*info));
+    if (auto format_ctx = shared->fast_open(path); format_ctx.has_value()) {
+      return {std::move(*format_ctx), std::move(shared), true};
+    }
+    spdlog::debug("Cached probe result for '{}' does not match, reprobing",
+                  path);
+  }
+
+  format_context format_ctx{path};
+  auto info = std::make_shared<const media_info>(
+      media_info::capture(format_ctx));
+  store(identity, *info);
+  return {std::move(format_ctx), std::move(info), false};
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "disk_cache.hpp"
+#include "file_identity.hpp"
+#include "media_info.hpp"
+#include "wrappers/avformat.hpp"
+#include <filesystem>
+#include <memory>
+#include <tl/optional.hpp>
+
+namespace libved::ffmpeg {
+struct probed_input {
+  format_context context;
+  std::shared_ptr<const media_info> info;
+  // Whether `info` came from the cache instead of a full probe.
+  bool cached;
+};
+
+// On-disk cache of media_info, keyed by file identity, so that files seen in
+// earlier sessions open without avformat_find_stream_info. Entries are
+// tagged with the libavformat/libavcodec versions that produced them.
+class probe_cache {
+public:
+  explicit probe_cache(
+      std::filesystem::path directory = cache_directory("probe"));
+
+  [[nodiscard]] tl::optional<media_info>
+  load(const file_identity &identity) const;
+  // Failures are logged, not thrown: the cache is only an optimisation.
+  void store(const file_identity &identity, const media_info &info) const;
+
+  [[nodiscard]] probed_input open(const char *path,
+                                  const file_identity &identity) const;
+  [[nodiscard]] probed_input open(const char *path) const {
+    return open(path, file_identity::of(path));
+  }
+
+private:
+  [[nodiscard]] std::filesystem::path
+  entry_path(const file_identity &identity) const;
+
+  std::filesystem::path m_directory;
+};
+} // namespace libved::ffmpeg
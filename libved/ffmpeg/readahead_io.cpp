@@ -0,0 +1,463 @@
+#include "readahead_io.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+#ifdef LIBVED_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+namespace libved::ffmpeg {
+struct readahead_io::request {
+  std::int64_t offset = 0;
+  std::vector<std::uint8_t> data;
+  // Number of bytes read, or a negative errno. Published by `done`.
+  int result = 0;
+  std::atomic<bool> done{false};
+  bool cancelled = false;
+  bool counted = false;
+  bool consumed = false;
+};
+
+class readahead_io::engine {
+public:
+  virtual ~engine() = default;
+
+  virtual void submit(std::shared_ptr<request> req) = 0;
+  virtual void wait(request &req) = 0;
+  virtual void cancel(const std::shared_ptr<request> &req) = 0;
+  [[nodiscard]] virtual bool is_io_uring() const noexcept { return false; }
+};
+
+static int pread_full(int fd, std::uint8_t *buf, std::size_t size,
+                      std::int64_t offset) {
+  std::size_t total = 0;
+  while (total < size) {
+    const auto ret = pread(fd, buf + total, size - total,
+                           static_cast<off_t>(offset + total));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    if (ret == 0) {
+      break;
+    }
+    total += static_cast<std::size_t>(ret);
+  }
+  return static_cast<int>(total);
+}
+
+namespace {
+class thread_pool_engine final : public readahead_io::engine {
+public:
+  thread_pool_engine(int fd, std::size_t threads) : m_fd{fd} {
+    for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i) {
+      m_workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~thread_pool_engine() override {
+    {
+      std::lock_guard lock{m_mutex};
+      m_stopping = true;
+      m_pending.clear();
+    }
+    m_pending_cv.notify_all();
+    m_workers.clear();
+  }
+
+  void submit(std::shared_ptr<readahead_io::request> req) override {
+    {
+      std::lock_guard lock{m_mutex};
+      m_pending.push_back(std::move(req));
+    }
+    m_pending_cv.notify_one();
+  }
+
+  void wait(readahead_io::request &req) override {
+    std::unique_lock lock{m_mutex};
+    m_done_cv.wait(lock, [&] { return req.done.load(); });
+  }
+
+  void cancel(const std::shared_ptr<readahead_io::request> &req) override {
+    std::lock_guard lock{m_mutex};
+    req->cancelled = true;
+    std::erase(m_pending, req);
+  }
+
+private:
+  void work() {
+    while (true) {
+      std::shared_ptr<readahead_io::request> req;
+      {
+        std::unique_lock lock{m_mutex};
+        m_pending_cv.wait(lock,
+                          [this] { return m_stopping || !m_pending.empty(); });
+        if (m_stopping) {
+          return;
+        }
+        req = std::move(m_pending.front());
+        m_pending.pop_front();
+      }
+
+      // A cancelled request may still be running here; the shared_ptr keeps
+      // its buffer alive until the read returns.
+      req->result =
+          pread_full(m_fd, req->data.data(), req->data.size(), req->offset);
+      {
+        std::lock_guard lock{m_mutex};
+        req->done.store(true, std::memory_order_release);
+      }
+      m_done_cv.notify_all();
+    }
+  }
+
+  int m_fd;
+  std::mutex m_mutex;
+  std::condition_variable m_pending_cv;
+  std::condition_variable m_done_cv;
+  std::deque<std::shared_ptr<readahead_io::request>> m_pending;
+  bool m_stopping = false;
+  std::vector<std::jthread> m_workers;
+};
+
+#ifdef LIBVED_HAVE_IO_URING
+// All ring operations happen on the thread that drives the AVIOContext, so
+// the ring needs no locking.
+class io_uring_engine final : public readahead_io::engine {
+public:
+  io_uring_engine(int fd, unsigned depth) : m_fd{fd} {
+    if (const int ret = io_uring_queue_init(depth, &m_ring, 0); ret < 0) {
+      throw std::system_error{-ret, std::generic_category(),
+                              "Unable to create io_uring"};
+    }
+  }
+
+  ~io_uring_engine() override {
+    // get_sqe() may reap, which erases from m_in_flight.
+    std::vector<readahead_io::request *> in_flight;
+    in_flight.reserve(m_in_flight.size());
+    for (const auto &[ptr, req] : m_in_flight) {
+      in_flight.push_back(ptr);
+    }
+    try {
+      for (auto *req : in_flight) {
+        prep_cancel(req);
+      }
+      io_uring_submit(&m_ring);
+      while (!m_in_flight.empty()) {
+        reap(true);
+      }
+    } catch (std::exception &ex) {
+      spdlog::warn("Unable to cancel io_uring reads: {}", ex.what());
+    }
+    io_uring_queue_exit(&m_ring);
+  }
+
+  void submit(std::shared_ptr<readahead_io::request> req) override {
+    auto *sqe = get_sqe();
+    io_uring_prep_read(sqe, m_fd, req->data.data(),
+                       static_cast<unsigned>(req->data.size()),
+                       static_cast<__u64>(req->offset));
+    io_uring_sqe_set_data(sqe, req.get());
+    m_in_flight.emplace(req.get(), std::move(req));
+    io_uring_submit(&m_ring);
+  }
+
+  void wait(readahead_io::request &req) override {
+    while (!req.done.load(std::memory_order_acquire)) {
+      reap(true);
+    }
+  }
+
+  void cancel(const std::shared_ptr<readahead_io::request> &req) override {
+    req->cancelled = true;
+    if (!req->done.load(std::memory_order_acquire)) {
+      prep_cancel(req.get());
+      io_uring_submit(&m_ring);
+    }
+    reap(false);
+  }
+
+  [[nodiscard]] bool is_io_uring() const noexcept override { return true; }
+
+private:
+  io_uring_sqe *get_sqe() {
+    auto *sqe = io_uring_get_sqe(&m_ring);
+    while (sqe == nullptr) {
+      io_uring_submit(&m_ring);
+      reap(true);
+      sqe = io_uring_get_sqe(&m_ring);
+    }
+    return sqe;
+  }
+
+  void prep_cancel(readahead_io::request *req) {
+    auto *sqe = get_sqe();
+    io_uring_prep_cancel(sqe, req, 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+  }
+
+  void reap(bool block) {
+    io_uring_cqe *cqe = nullptr;
+    int ret = block ? io_uring_wait_cqe(&m_ring, &cqe)
+                    : io_uring_peek_cqe(&m_ring, &cqe);
+    if (ret < 0 && ret != -EAGAIN && ret != -EINTR) {
+      throw std::system_error{-ret, std::generic_category(),
+                              "Unable to wait for io_uring completion"};
+    }
+
+    while (ret == 0 && cqe != nullptr) {
+      auto *req =
+          static_cast<readahead_io::request *>(io_uring_cqe_get_data(cqe));
+      if (req != nullptr) {
+        req->result = cqe->res;
+        req->done.store(true, std::memory_order_release);
+        m_in_flight.erase(req);
+      }
+      io_uring_cqe_seen(&m_ring, cqe);
+      ret = io_uring_peek_cqe(&m_ring, &cqe);
+    }
+  }
+
+  int m_fd;
+  io_uring m_ring{};
+  std::unordered_map<readahead_io::request *,
+                     std::shared_ptr<readahead_io::request>>
+      m_in_flight;
+};
+#endif
+
+std::unique_ptr<readahead_io::engine>
+make_engine(int fd, const readahead_params &params) {
+#ifdef LIBVED_HAVE_IO_URING
+  if (params.use_io_uring) {
+    try {
+      const auto depth =
+          std::bit_ceil(static_cast<unsigned>(params.window_chunks * 2));
+      return std::make_unique<io_uring_engine>(fd, depth);
+    } catch (std::exception &ex) {
+      spdlog::warn("io_uring unavailable, using read-ahead threads: {}",
+                   ex.what());
+    }
+  }
+#endif
+  return std::make_unique<thread_pool_engine>(fd, params.worker_threads);
+}
+} // namespace
+
+readahead_io::readahead_io(const char *path, readahead_params params)
+    : m_params{params} {
+  if (params.chunk_size == 0 || params.window_chunks == 0 ||
+      params.chunk_size > static_cast<std::size_t>(INT32_MAX)) {
+    throw std::invalid_argument{"Invalid read-ahead parameters"};
+  }
+
+  m_fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (m_fd < 0) {
+    throw std::system_error{errno, std::generic_category(),
+                            fmt::format("Unable to open '{}'", path)};
+  }
+
+  struct stat st {};
+  if (fstat(m_fd, &st) != 0) {
+    const auto err = errno;
+    close(m_fd);
+    throw std::system_error{err, std::generic_category(),
+                            fmt::format("Unable to stat '{}'", path)};
+  }
+  m_size = static_cast<std::size_t>(st.st_size);
+
+  try {
+    m_engine = make_engine(m_fd, m_params);
+    fill_window();
+  } catch (...) {
+    // The engines keep the buffers of submitted requests alive.
+    m_window.clear();
+    m_engine.reset();
+    close(m_fd);
+    throw;
+  }
+}
+
+readahead_io::~readahead_io() {
+  for (const auto &req : m_window) {
+    if (!req->done.load(std::memory_order_acquire)) {
+      m_engine->cancel(req);
+    }
+  }
+  m_window.clear();
+  m_engine.reset();
+  close(m_fd);
+}
+
+bool readahead_io::uses_io_uring() const noexcept {
+  return m_engine->is_io_uring();
+}
+
+readahead_stats readahead_io::stats() const noexcept {
+  return {
+      .bytes_prefetched = m_bytes_prefetched.load(std::memory_order_relaxed),
+      .hits = m_hits.load(std::memory_order_relaxed),
+      .misses = m_misses.load(std::memory_order_relaxed),
+      .wasted_reads = m_wasted_reads.load(std::memory_order_relaxed),
+  };
+}
+
+void readahead_io::drop_front() {
+  const auto &req = m_window.front();
+  if (!req->consumed) {
+    m_wasted_reads.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (!req->done.load(std::memory_order_acquire)) {
+    m_engine->cancel(req);
+  }
+  m_window.pop_front();
+  ++m_window_begin;
+}
+
+void readahead_io::move_window(std::size_t first_chunk) {
+  while (!m_window.empty()) {
+    drop_front();
+  }
+  m_window_begin = first_chunk;
+  fill_window();
+}
+
+void readahead_io::fill_window() {
+  while (m_window.size() < m_params.window_chunks) {
+    const auto offset = (m_window_begin + m_window.size()) * m_params.chunk_size;
+    if (offset >= m_size) {
+      return;
+    }
+
+    auto req = std::make_shared<request>();
+    req->offset = static_cast<std::int64_t>(offset);
+    req->data.resize(std::min(m_params.chunk_size, m_size - offset));
+    m_window.push_back(req);
+    m_engine->submit(std::move(req));
+  }
+}
+
+int readahead_io::finish_request(request &req) {
+  if (req.counted) {
+    return std::min(req.result, 0);
+  }
+
+  if (req.done.load(std::memory_order_acquire)) {
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    m_engine->wait(req);
+  }
+  req.counted = true;
+
+  if (req.result < 0) {
+    return req.result;
+  }
+
+  auto bytes = static_cast<std::size_t>(req.result);
+  if (bytes < req.data.size()) {
+    const auto rest = pread_full(m_fd, req.data.data() + bytes,
+                                 req.data.size() - bytes,
+                                 req.offset + static_cast<std::int64_t>(bytes));
+    if (rest < 0) {
+      req.result = rest;
+      return rest;
+    }
+    bytes += static_cast<std::size_t>(rest);
+    req.data.resize(bytes);
+    req.result = static_cast<int>(bytes);
+  }
+
+  m_bytes_prefetched.fetch_add(bytes, std::memory_order_relaxed);
+  return 0;
+}
+
+int readahead_io::read(std::uint8_t *buf, int buf_size) {
+  if (m_position >= m_size) {
+    return AVERROR_EOF;
+  }
+
+  const auto chunk = m_position / m_params.chunk_size;
+  if (chunk < m_window_begin ||
+      chunk >= m_window_begin + m_params.window_chunks) {
+    move_window(chunk);
+  }
+  while (m_window_begin < chunk) {
+    drop_front();
+  }
+  fill_window();
+
+  auto &req = *m_window.front();
+  if (const int ret = finish_request(req); ret < 0) {
+    return ret;
+  }
+
+  const auto in_chunk =
+      m_position - static_cast<std::size_t>(req.offset);
+  if (in_chunk >= req.data.size()) {
+    return AVERROR_EOF;
+  }
+
+  const auto count =
+      std::min(static_cast<std::size_t>(buf_size), req.data.size() - in_chunk);
+  std::memcpy(buf, req.data.data() + in_chunk, count);
+  req.consumed = true;
+  m_position += count;
+  return static_cast<int>(count);
+}
+
+std::int64_t readahead_io::seek(std::int64_t offset, int whence) {
+  const auto size = static_cast<std::int64_t>(m_size);
+  std::int64_t base = 0;
+  switch (whence & ~AVSEEK_FORCE) {
+  case AVSEEK_SIZE:
+    return size;
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = static_cast<std::int64_t>(m_position);
+    break;
+  case SEEK_END:
+    base = size;
+    break;
+  default:
+    return AVERROR(EINVAL);
+  }
+
+  const auto target = base + offset;
+  if (target < 0 || target > size) {
+    return AVERROR(EINVAL);
+  }
+
+  m_position = static_cast<std::size_t>(target);
+  // Cancel the reads of the old window right away instead of on the next
+  // read(), so the new window can start filling immediately.
+  const auto chunk = m_position / m_params.chunk_size;
+  if (chunk < m_window_begin ||
+      chunk >= m_window_begin + m_params.window_chunks) {
+    move_window(chunk);
+  }
+  return target;
+}
+} // namespace libved::ffmpeg
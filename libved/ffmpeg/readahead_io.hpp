@@ -0,0 +1,72 @@
+#pragma once
+
+#include "wrappers/avio.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct readahead_params {
+  std::size_t chunk_size = 1 << 20;
+  // Number of chunks kept in flight ahead of the read position.
+  std::size_t window_chunks = 8;
+  // Only used when io_uring is unavailable.
+  std::size_t worker_threads = 2;
+  bool use_io_uring = true;
+};
+
+struct readahead_stats {
+  std::uint64_t bytes_prefetched = 0;
+  // Chunks that were already in memory when the demuxer asked for them.
+  std::uint64_t hits = 0;
+  // Chunks the demuxer had to wait for.
+  std::uint64_t misses = 0;
+  // Chunks that were dropped after a seek without ever being read.
+  std::uint64_t wasted_reads = 0;
+};
+
+// Keeps a window of upcoming chunks of a local file in flight, so that
+// format_context::read_frame only blocks when the disk is slower than the
+// demuxer. Reads are issued through io_uring when the kernel and build allow
+// it, and through a small pool of pread() threads otherwise.
+class readahead_io : public io_backend {
+public:
+  struct request;
+  class engine;
+
+  readahead_io(const char *path, readahead_params params = {});
+  ~readahead_io() override;
+
+  readahead_io(const readahead_io &) = delete;
+  readahead_io &operator=(const readahead_io &) = delete;
+
+  int read(std::uint8_t *buf, int buf_size) override;
+  std::int64_t seek(std::int64_t offset, int whence) override;
+
+  [[nodiscard]] readahead_stats stats() const noexcept;
+  [[nodiscard]] bool uses_io_uring() const noexcept;
+
+private:
+  void move_window(std::size_t first_chunk);
+  void fill_window();
+  void drop_front();
+  int finish_request(request &req);
+
+  readahead_params m_params;
+  int m_fd = -1;
+  std::size_t m_size = 0;
+  std::size_t m_position = 0;
+  std::unique_ptr<engine> m_engine;
+
+  std::size_t m_window_begin = 0;
+  std::deque<std::shared_ptr<request>> m_window;
+
+  std::atomic<std::uint64_t> m_bytes_prefetched{0};
+  std::atomic<std::uint64_t> m_hits{0};
+  std::atomic<std::uint64_t> m_misses{0};
+  std::atomic<std::uint64_t> m_wasted_reads{0};
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,183 @@
+#include "seek_index.hpp"
+#include <algorithm>
+#include <errors.hpp>
+#include <stdexcept>
+
+namespace libved::ffmpeg {
+namespace {
+constexpr std::uint32_t seek_index_magic = 0x4953564c; // "LVSI"
+constexpr std::uint32_t seek_index_version = 1;
+
+struct seek_index_header {
+  std::uint32_t magic = seek_index_magic;
+  std::uint32_t version = seek_index_version;
+  std::int32_t stream_index;
+  AVRational time_base;
+  std::uint32_t reserved = 0;
+  std::uint64_t packet_count;
+  std::uint64_t keyframe_count;
+  file_identity identity;
+};
+
+static_assert(sizeof(seek_index_header) % alignof(seek_index_entry) == 0);
+
+std::int64_t entry_pts(const seek_index_entry &e) {
+  return e.pts != AV_NOPTS_VALUE ? e.pts : e.dts;
+}
+} // namespace
+
+seek_index seek_index::build(const char *path, std::size_t stream_index) {
+  format_context format_ctx{path};
+  if (stream_index == format_context::npos) {
+    stream_index = std::get<0>(format_ctx.find_stream(AVMEDIA_TYPE_VIDEO));
+    if (stream_index == format_context::npos) {
+      throw std::runtime_error{
+          fmt::format("No video stream to index in '{}'", path)};
+    }
+  }
+
+  const auto streams = format_ctx.streams();
+  for (std::size_t i = 0; i < streams.size(); ++i) {
+    streams[i]->discard = i == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+
+  std::vector<seek_index_entry> entries;
+  for (auto &&[pkt, guard] : format_ctx.read_frames()) {
+    const auto &p = **pkt;
+    if (static_cast<std::size_t>(p.stream_index) != stream_index) {
+      continue;
+    }
+    entries.push_back({
+        .pts = p.pts,
+        .dts = p.dts,
+        .pos = p.pos,
+        .flags = static_cast<std::uint32_t>(p.flags),
+        .reserved = 0,
+    });
+  }
+
+  const auto packet_count = entries.size();
+  for (std::size_t i = 0; i < packet_count; ++i) {
+    const auto e = entries[i];
+    if ((e.flags & AV_PKT_FLAG_KEY) != 0 && entry_pts(e) != AV_NOPTS_VALUE) {
+      entries.push_back(e);
+    }
+  }
+  std::stable_sort(entries.begin() + static_cast<std::ptrdiff_t>(packet_count),
+                   entries.end(), [](const auto &lhs, const auto &rhs) {
+                     return entry_pts(lhs) < entry_pts(rhs);
+                   });
+
+  seek_index index;
+  index.m_stream_index = stream_index;
+  index.m_time_base = streams[stream_index]->time_base;
+  const auto &stored =
+      index.m_storage.emplace<std::vector<seek_index_entry>>(std::move(entries));
+  index.m_packets = std::span{stored}.first(packet_count);
+  index.m_keyframes = std::span{stored}.subspan(packet_count);
+  return index;
+}
+
+tl::optional<seek_index> seek_index::load(const std::filesystem::path &file,
+                                          const file_identity &identity) {
+  std::shared_ptr<mapped_file> mapping;
+  try {
+    mapping = std::make_shared<mapped_file>(file.c_str());
+  } catch (std::exception &) {
+    return tl::nullopt;
+  }
+
+  seek_index_header header{};
+  byte_reader reader{mapping->bytes()};
+  if (!reader.read(header) || header.magic != seek_index_magic ||
+      header.version != seek_index_version || header.identity != identity ||
+      header.stream_index < 0) {
+    return tl::nullopt;
+  }
+
+  const auto count = header.packet_count + header.keyframe_count;
+  if (mapping->size() !=
+      sizeof(seek_index_header) + count * sizeof(seek_index_entry)) {
+    return tl::nullopt;
+  }
+
+  // mmap returns page-aligned memory and the header keeps the entries
+  // aligned, so the mapping can be viewed as entries directly.
+  const auto *entries = reinterpret_cast<const seek_index_entry *>(
+      mapping->data() + sizeof(seek_index_header));
+  seek_index index;
+  index.m_stream_index = static_cast<std::size_t>(header.stream_index);
+  index.m_time_base = header.time_base;
+  index.m_packets = std::span{entries, header.packet_count};
+  index.m_keyframes =
+      std::span{entries + header.packet_count, header.keyframe_count};
+  index.m_storage = std::move(mapping);
+  return index;
+}
+
+void seek_index::save(const std::filesystem::path &file,
+                      const file_identity &identity) const {
+  byte_writer writer;
+  writer.write(seek_index_header{
+      .stream_index = static_cast<std::int32_t>(m_stream_index),
+      .time_base = m_time_base,
+      .packet_count = m_packets.size(),
+      .keyframe_count = m_keyframes.size(),
+      .identity = identity,
+  });
+  writer.write_bytes(std::as_bytes(m_packets));
+  writer.write_bytes(std::as_bytes(m_keyframes));
+  write_file_atomic(file, writer.data());
+}
+
+seek_index seek_index::load_or_build(const char *path,
+                                     const std::filesystem::path &directory) {
+  const auto identity = file_identity::of(path);
+  const auto file = directory / (identity.to_string() + ".seekidx");
+  if (auto index = load(file, identity); index.has_value()) {
+    return std::move(*index);
+  }
+
+  auto index = build(path);
+  try {
+    index.save(file, identity);
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+  return index;
+}
+
+tl::optional<const seek_index_entry &>
+seek_index::keyframe_before(std::int64_t pts) const {
+  if (m_keyframes.empty()) {
+    return tl::nullopt;
+  }
+
+  auto it = std::upper_bound(
+      m_keyframes.begin(), m_keyframes.end(), pts,
+      [](std::int64_t value, const auto &e) { return value < entry_pts(e); });
+  return it == m_keyframes.begin() ? *it : *std::prev(it);
+}
+
+tl::optional<const seek_index_entry &>
+seek_index::seek(format_context &format_ctx, std::int64_t pts) const {
+  auto keyframe = keyframe_before(pts);
+  if (!keyframe.has_value()) {
+    return tl::nullopt;
+  }
+
+  // Timestamps of MPEG-TS/PS-like formats are unreliable to seek by, but
+  // their byte positions are exact.
+  const auto flags = format_ctx->iformat->flags;
+  const bool byte_seek = (flags & AVFMT_TS_DISCONT) != 0 &&
+                         (flags & AVFMT_NO_BYTE_SEEK) == 0 &&
+                         keyframe->pos >= 0;
+  if (byte_seek) {
+    format_ctx.seek(m_stream_index, keyframe->pos, AVSEEK_FLAG_BYTE);
+  } else {
+    format_ctx.seek(m_stream_index, entry_pts(*keyframe),
+                    AVSEEK_FLAG_BACKWARD);
+  }
+  return keyframe;
+}
+} // namespace libved::ffmpeg
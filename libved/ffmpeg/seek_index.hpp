@@ -0,0 +1,82 @@
+#pragma once
+
+#include "disk_cache.hpp"
+#include "file_identity.hpp"
+#include "mapped_file.hpp"
+#include "wrappers/avformat.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <tl/optional.hpp>
+#include <variant>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct seek_index_entry {
+  std::int64_t pts;
+  std::int64_t dts;
+  // Byte position of the packet in the file, or -1 if unknown.
+  std::int64_t pos;
+  std::uint32_t flags;
+  std::uint32_t reserved;
+};
+
+// Every packet of one video stream, built by demuxing the file once. The
+// on-disk format is a fixed header followed by the packets in decode order
+// and then the keyframes sorted by pts, so a saved index is used straight
+// from its mapping without parsing.
+class seek_index {
+public:
+  seek_index(seek_index &&) = default;
+  seek_index &operator=(seek_index &&) = default;
+  seek_index(const seek_index &) = delete;
+  seek_index &operator=(const seek_index &) = delete;
+
+  [[nodiscard]] static seek_index
+  build(const char *path, std::size_t stream_index = format_context::npos);
+  [[nodiscard]] static tl::optional<seek_index>
+  load(const std::filesystem::path &file, const file_identity &identity);
+  void save(const std::filesystem::path &file,
+            const file_identity &identity) const;
+
+  // Loads the index of `path` from `directory`, building and saving it first
+  // if it is missing or stale.
+  [[nodiscard]] static seek_index
+  load_or_build(const char *path,
+                const std::filesystem::path &directory =
+                    cache_directory("seek_index"));
+
+  [[nodiscard]] std::size_t stream_index() const noexcept {
+    return m_stream_index;
+  }
+  [[nodiscard]] AVRational time_base() const noexcept { return m_time_base; }
+  [[nodiscard]] std::span<const seek_index_entry> packets() const noexcept {
+    return m_packets;
+  }
+  [[nodiscard]] std::span<const seek_index_entry> keyframes() const noexcept {
+    return m_keyframes;
+  }
+
+  // Last keyframe with pts <= `pts`, or the first keyframe if there is none.
+  [[nodiscard]] tl::optional<const seek_index_entry &>
+  keyframe_before(std::int64_t pts) const;
+
+  // Positions `format_ctx` on the keyframe returned by keyframe_before(pts),
+  // by byte position for MPEG-TS-like formats and by the keyframe's exact
+  // timestamp otherwise.
+  tl::optional<const seek_index_entry &> seek(format_context &format_ctx,
+                                              std::int64_t pts) const;
+
+private:
+  seek_index() = default;
+
+  std::size_t m_stream_index = 0;
+  AVRational m_time_base{0, 1};
+  std::variant<std::vector<seek_index_entry>, std::shared_ptr<mapped_file>>
+      m_storage;
+  std::span<const seek_index_entry> m_packets;
+  std::span<const seek_index_entry> m_keyframes;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,143 @@
+#include "seekable_decoder.hpp"
+#include <algorithm>
+
+namespace libved::ffmpeg {
+namespace {
+// Puts back the skip_frame setting that seeking overrides, also when
+// seeking or decoding throws.
+class skip_frame_guard {
+public:
+  skip_frame_guard(AVCodecContext *ctx, std::int64_t &skip_until)
+      : m_ctx{ctx}, m_skip_frame{ctx->skip_frame}, m_skip_until{skip_until} {}
+  ~skip_frame_guard() {
+    m_skip_until = AV_NOPTS_VALUE;
+    m_ctx->skip_frame = m_skip_frame;
+  }
+
+  skip_frame_guard(const skip_frame_guard &) = delete;
+  skip_frame_guard &operator=(const skip_frame_guard &) = delete;
+
+private:
+  AVCodecContext *m_ctx;
+  AVDiscard m_skip_frame;
+  std::int64_t &m_skip_until;
+};
+} // namespace
+
+seekable_decoder::seekable_decoder(format_context &format_ctx,
+                                   codec_context &codec_ctx,
+                                   std::size_t stream_index,
+                                   const seek_index *index)
+    : m_format_ctx{format_ctx}, m_codec_ctx{codec_ctx},
+      m_stream_index{stream_index},
+      m_index{index != nullptr && index->stream_index() == stream_index
+                  ? index
+                  : nullptr},
+      m_packet{alloc_packet()}, m_previous{alloc_frame()},
+      m_pending{alloc_frame()} {}
+
+bool seekable_decoder::send_next_packet() {
+  while (true) {
+    auto result = m_format_ctx.try_read_frame(m_packet.get());
+    if (result.is_eof()) {
+      return false;
+    }
+
+    result.value_or_throw(no_throw_nested());
+    packet_unref_guard guard{m_packet};
+    if (static_cast<std::size_t>(m_packet->stream_index) != m_stream_index) {
+      continue;
+    }
+
+    if (m_skip_until != AV_NOPTS_VALUE) {
+      // A frame whose display interval reaches the target may be the one
+      // shown at it, so only frames that end before it are skipped.
+      const auto pts = m_packet->pts;
+      const auto duration = m_packet->duration;
+      const bool skip = pts != AV_NOPTS_VALUE && duration > 0 &&
+                        pts + duration <= m_skip_until;
+      m_codec_ctx->skip_frame =
+          skip ? std::max(m_skip_frame, AVDISCARD_NONREF) : m_skip_frame;
+    }
+    m_codec_ctx.send_packet(m_packet);
+    return true;
+  }
+}
+
+bool seekable_decoder::decode_next(AVFrame *out) {
+  while (true) {
+    switch (m_codec_ctx.receive_frame(out)) {
+    case send_receive_result::success:
+      return true;
+    case send_receive_result::eof:
+      return false;
+    case send_receive_result::eagain:
+      break;
+    }
+
+    if (m_demux_eof) {
+      return false;
+    }
+    if (!send_next_packet()) {
+      m_demux_eof = true;
+      m_codec_ctx.send_packet(nullptr);
+    }
+  }
+}
+
+bool seekable_decoder::read_frame(AVFrame *out) {
+  if (m_has_pending) {
+    av_frame_unref(out);
+    av_frame_move_ref(out, m_pending.get());
+    m_has_pending = false;
+    return true;
+  }
+  return decode_next(out);
+}
+
+bool seekable_decoder::seek_to(std::int64_t pts, AVFrame *out) {
+  m_skip_frame = m_codec_ctx->skip_frame;
+  const skip_frame_guard guard{m_codec_ctx.get(), m_skip_until};
+  m_codec_ctx.flush_buffers();
+  av_frame_unref(m_pending.get());
+  m_has_pending = false;
+  m_demux_eof = false;
+
+  if (m_index == nullptr || !m_index->seek(m_format_ctx, pts).has_value()) {
+    m_format_ctx.seek(m_stream_index, pts, AVSEEK_FLAG_BACKWARD);
+  }
+
+  m_skip_until = pts;
+  bool has_previous = false;
+  bool found = false;
+  while (decode_next(out)) {
+    const auto timestamp = frame_timestamp(out);
+    if (timestamp == pts) {
+      found = true;
+      break;
+    }
+    if (timestamp == AV_NOPTS_VALUE || timestamp < pts) {
+      av_frame_unref(m_previous.get());
+      av_frame_move_ref(m_previous.get(), out);
+      has_previous = true;
+      continue;
+    }
+
+    // Overshot: `pts` falls inside the previous frame's display interval.
+    if (has_previous) {
+      av_frame_move_ref(m_pending.get(), out);
+      m_has_pending = true;
+      av_frame_move_ref(out, m_previous.get());
+    }
+    found = true;
+    break;
+  }
+
+  if (!found && has_previous) {
+    av_frame_move_ref(out, m_previous.get());
+    found = true;
+  }
+  av_frame_unref(m_previous.get());
+  return found;
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "seek_index.hpp"
+#include "wrappers/avcodec.hpp"
+#include "wrappers/avformat.hpp"
+#include "wrappers/avutil.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace libved::ffmpeg {
+inline std::int64_t frame_timestamp(const AVFrame *frame) {
+  return frame->best_effort_timestamp != AV_NOPTS_VALUE
+             ? frame->best_effort_timestamp
+             : frame->pts;
+}
+
+// Decodes one stream of a format_context with frame-accurate random access.
+// Seeking reuses the opened codec_context: it is flushed, not recreated.
+class seekable_decoder {
+public:
+  seekable_decoder(format_context &format_ctx, codec_context &codec_ctx,
+                   std::size_t stream_index,
+                   const seek_index *index = nullptr);
+
+  // Next frame in presentation order. Returns false at the end of the
+  // stream.
+  bool read_frame(AVFrame *out);
+  // The frame displayed at `pts` (in stream time base): the last frame
+  // whose timestamp is not after `pts`. Returns false if the stream has no
+  // frames at all past the seek point.
+  bool seek_to(std::int64_t pts, AVFrame *out);
+
+  decltype(auto) read_frame(const frame &frm) { return read_frame(frm.get()); }
+  decltype(auto) seek_to(std::int64_t pts, const frame &frm) {
+    return seek_to(pts, frm.get());
+  }
+
+private:
+  bool decode_next(AVFrame *out);
+  bool send_next_packet();
+
+  format_context &m_format_ctx;
+  codec_context &m_codec_ctx;
+  std::size_t m_stream_index;
+  const seek_index *m_index;
+
+  packet m_packet;
+  frame m_previous;
+  frame m_pending;
+  bool m_has_pending = false;
+  bool m_demux_eof = false;
+  // Non-reference frames displayed entirely before this are not decoded
+  // while seeking.
+  std::int64_t m_skip_until = AV_NOPTS_VALUE;
+  AVDiscard m_skip_frame = AVDISCARD_DEFAULT;
+};
+} // namespace libved::ffmpeg
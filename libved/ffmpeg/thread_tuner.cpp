@@ -0,0 +1,245 @@
+#include "thread_tuner.hpp"
+#include "wrappers/avformat.hpp"
+#include <algorithm>
+#include <chrono>
+#include <errors.hpp>
+#include <spdlog/spdlog.h>
+#include <thread>
+#include <vector>
+
+namespace libved::ffmpeg {
+namespace {
+constexpr std::uint32_t thread_tuner_magic = 0x5454564c; // "LVTT"
+constexpr std::uint32_t thread_tuner_version = 1;
+constexpr int benchmark_frames = 48;
+constexpr auto benchmark_time_limit = std::chrono::seconds{2};
+
+struct thread_tuner_header {
+  std::uint32_t magic = thread_tuner_magic;
+  std::uint32_t version = thread_tuner_version;
+  std::uint32_t avcodec_version = LIBAVCODEC_VERSION_INT;
+  std::uint32_t hardware_threads = std::thread::hardware_concurrency();
+};
+
+struct policy_record {
+  std::int32_t codec_id;
+  std::int32_t width;
+  std::int32_t height;
+  std::uint8_t goal;
+  std::uint8_t mode;
+  std::int32_t thread_count;
+};
+
+struct benchmark_result {
+  std::chrono::duration<double> first_frame;
+  double frames_per_second;
+};
+
+int cpu_threads() {
+  return static_cast<int>(
+      std::clamp(std::thread::hardware_concurrency(), 1U, 16U));
+}
+
+tl::optional<benchmark_result> run_benchmark(const char *path,
+                                             std::size_t stream_index,
+                                             const threading_policy &policy) {
+  using clock = std::chrono::steady_clock;
+  try {
+    format_context format_ctx{path};
+    codec_context codec_ctx{*format_ctx.streams()[stream_index]};
+    codec_ctx.set_threading(policy);
+    codec_ctx.init();
+
+    auto frame = alloc_frame();
+    int frames = 0;
+    const auto start = clock::now();
+    auto first_frame = clock::duration::zero();
+    const auto receive_all = [&] {
+      while (true) {
+        auto result = codec_ctx.try_receive_frame(frame.get());
+        if (!result.has_value() || *result != send_receive_result::success) {
+          return;
+        }
+        if (frames++ == 0) {
+          first_frame = clock::now() - start;
+        }
+        av_frame_unref(frame.get());
+      }
+    };
+
+    for (auto &&[pkt, guard] : format_ctx.read_frames()) {
+      if (static_cast<std::size_t>((*pkt)->stream_index) != stream_index) {
+        continue;
+      }
+      if (!codec_ctx.try_send_packet(pkt->get()).has_value()) {
+        continue;
+      }
+      receive_all();
+      if (frames >= benchmark_frames ||
+          clock::now() - start > benchmark_time_limit) {
+        break;
+      }
+    }
+    if (frames < benchmark_frames) {
+      codec_ctx.try_send_packet(nullptr);
+      receive_all();
+    }
+
+    const std::chrono::duration<double> elapsed = clock::now() - start;
+    if (frames == 0 || elapsed.count() <= 0) {
+      return tl::nullopt;
+    }
+    return benchmark_result{first_frame, frames / elapsed.count()};
+  } catch (std::exception &ex) {
+    log_exception(ex);
+    return tl::nullopt;
+  }
+}
+
+std::vector<threading_policy> candidates(const codec &codec) {
+  const int threads = cpu_threads();
+  std::vector<threading_policy> result{{threading_mode::slice, 1}};
+  if (threads == 1) {
+    return result;
+  }
+  if (codec.capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+    result.push_back({threading_mode::slice, threads});
+  }
+  if (codec.capabilities & AV_CODEC_CAP_FRAME_THREADS) {
+    result.push_back({threading_mode::frame, threads / 2});
+    result.push_back({threading_mode::frame, threads});
+  }
+  return result;
+}
+} // namespace
+
+threading_policy default_threading(decode_goal goal) {
+  return {
+      .mode = goal == decode_goal::latency ? threading_mode::slice
+                                           : threading_mode::frame,
+      .thread_count = cpu_threads(),
+  };
+}
+
+thread_tuner::thread_tuner(std::filesystem::path directory)
+    : m_path{std::move(directory) / "policies"} {
+  load();
+}
+
+thread_tuner::key thread_tuner::key_of(const codec_params &params,
+                                       decode_goal goal) {
+  return {params.codec_id, params.width, params.height, goal};
+}
+
+void thread_tuner::load() {
+  const auto data = read_file(m_path);
+  if (!data.has_value()) {
+    return;
+  }
+
+  byte_reader reader{*data};
+  thread_tuner_header header;
+  const thread_tuner_header expected;
+  if (!reader.read(header) || header.magic != expected.magic ||
+      header.version != expected.version ||
+      header.avcodec_version != expected.avcodec_version ||
+      header.hardware_threads != expected.hardware_threads) {
+    return;
+  }
+
+  policy_record r{};
+  while (reader.read(r)) {
+    m_policies[{r.codec_id, r.width, r.height,
+                static_cast<decode_goal>(r.goal)}] = {
+        .mode = static_cast<threading_mode>(r.mode),
+        .thread_count = r.thread_count,
+    };
+  }
+}
+
+void thread_tuner::store() const {
+  byte_writer writer;
+  writer.write(thread_tuner_header{});
+  for (const auto &[k, policy] : m_policies) {
+    const auto &[codec_id, width, height, goal] = k;
+    writer.write(policy_record{
+        .codec_id = codec_id,
+        .width = width,
+        .height = height,
+        .goal = static_cast<std::uint8_t>(goal),
+        .mode = static_cast<std::uint8_t>(policy.mode),
+        .thread_count = policy.thread_count,
+    });
+  }
+
+  try {
+    write_file_atomic(m_path, writer.data());
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+}
+
+tl::optional<threading_policy>
+thread_tuner::cached_policy(const codec_params &params,
+                            decode_goal goal) const {
+  std::lock_guard lock{m_mutex};
+  const auto it = m_policies.find(key_of(params, goal));
+  if (it == m_policies.end()) {
+    return tl::nullopt;
+  }
+  return it->second;
+}
+
+threading_policy thread_tuner::policy_for(const char *path,
+                                          std::size_t stream_index,
+                                          decode_goal goal) {
+  codec_params_ptr params;
+  tl::optional<const codec &> decoder;
+  try {
+    format_context format_ctx{path};
+    params = copy_codec_params(*format_ctx.streams()[stream_index]->codecpar);
+    decoder = find_decoder(params->codec_id);
+  } catch (std::exception &ex) {
+    log_exception(ex);
+    return default_threading(goal);
+  }
+  if (!decoder.has_value()) {
+    return default_threading(goal);
+  }
+  if (auto cached = cached_policy(*params, goal); cached.has_value()) {
+    return *cached;
+  }
+
+  tl::optional<std::pair<threading_policy, benchmark_result>> best;
+  for (const auto &policy : candidates(*decoder)) {
+    const auto result = run_benchmark(path, stream_index, policy);
+    if (!result.has_value()) {
+      continue;
+    }
+    const bool better =
+        !best.has_value() ||
+        (goal == decode_goal::latency
+             ? result->first_frame < best->second.first_frame
+             : result->frames_per_second > best->second.frames_per_second);
+    if (better) {
+      best.emplace(policy, *result);
+    }
+  }
+  if (!best.has_value()) {
+    return default_threading(goal);
+  }
+
+  const auto &[policy, result] = *best;
+  spdlog::info("Decoder threading for {} {}x{}: {} threads ({}), {:.1f} fps, "
+               "first frame after {:.1f} ms",
+               decoder->name, params->width, params->height,
+               policy.thread_count,
+               policy.mode == threading_mode::frame ? "frame" : "slice",
+               result.frames_per_second, result.first_frame.count() * 1000);
+
+  std::lock_guard lock{m_mutex};
+  m_policies[key_of(*params, goal)] = policy;
+  store();
+  return policy;
+}
+} // namespace libved::ffmpeg
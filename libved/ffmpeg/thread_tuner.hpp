@@ -0,0 +1,53 @@
+#pragma once
+
+#include "disk_cache.hpp"
+#include "wrappers/avcodec.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace libved::ffmpeg {
+enum class decode_goal : std::uint8_t {
+  // Preview: the first frame after opening or seeking should come out as
+  // soon as possible.
+  latency,
+  // Export: as many frames per second as possible.
+  throughput,
+};
+
+// What to use when there is no measurement: slice threading for latency,
+// frame threading for throughput, one thread per CPU.
+[[nodiscard]] threading_policy default_threading(decode_goal goal);
+
+// Picks decoder threading per codec, resolution and goal by decoding the
+// start of a file with a few candidate policies, and remembers the winner on
+// disk so the benchmark runs once per machine and FFmpeg version.
+class thread_tuner {
+public:
+  explicit thread_tuner(
+      std::filesystem::path directory = cache_directory("threading"));
+
+  // Runs the benchmark on `path` unless a policy for the same codec and
+  // resolution is already known. Never throws; falls back to
+  // default_threading(goal) if the benchmark fails.
+  [[nodiscard]] threading_policy
+  policy_for(const char *path, std::size_t stream_index, decode_goal goal);
+
+  [[nodiscard]] tl::optional<threading_policy>
+  cached_policy(const codec_params &params, decode_goal goal) const;
+
+private:
+  using key = std::tuple<int, int, int, decode_goal>;
+
+  [[nodiscard]] static key key_of(const codec_params &params,
+                                  decode_goal goal);
+  void load();
+  void store() const;
+
+  std::filesystem::path m_path;
+  mutable std::mutex m_mutex;
+  std::map<key, threading_policy> m_policies;
+};
+} // namespace libved::ffmpeg
@@ -0,0 +1,347 @@
+#include "thumbnailer.hpp"
+#include "seekable_decoder.hpp"
+#include "wrappers/avcodec.hpp"
+#include "wrappers/avformat.hpp"
+#include "wrappers/swscale.hpp"
+#include <algorithm>
+#include <cmath>
+#include <errors.hpp>
+#include <fmt/core.h>
+#include <map>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+namespace libved::ffmpeg {
+namespace {
+constexpr std::uint32_t thumbnail_cache_magic = 0x4854564c; // "LVTH"
+constexpr std::uint32_t thumbnail_cache_version = 1;
+constexpr AVRational time_base_q{1, AV_TIME_BASE};
+
+struct thumbnail_cache_header {
+  std::uint32_t magic = thumbnail_cache_magic;
+  std::uint32_t version = thumbnail_cache_version;
+  file_identity identity;
+  std::int32_t width;
+  std::int32_t height;
+  std::uint32_t count;
+};
+
+struct thumbnail_record {
+  std::int64_t timestamp;
+  std::int64_t frame_time;
+  std::int32_t width;
+  std::int32_t height;
+};
+
+std::size_t rgba_size(int width, int height) {
+  return static_cast<std::size_t>(width) * height * 4;
+}
+
+int thumbnail_height(const thumbnail_params &params, const AVFrame &frm) {
+  if (params.height > 0) {
+    return params.height;
+  }
+  const double sar = frm.sample_aspect_ratio.num > 0
+                         ? av_q2d(frm.sample_aspect_ratio)
+                         : 1.0;
+  const auto height = static_cast<int>(
+      std::lround(params.width * frm.height / (frm.width * sar) / 2) * 2);
+  return std::max(height, 2);
+}
+
+// Decodes the first frame after the current position of `format_ctx`.
+bool decode_first(format_context &format_ctx, codec_context &codec_ctx,
+                  std::size_t stream_index, packet &pkt, frame &frm) {
+  while (true) {
+    auto read = format_ctx.try_read_frame(pkt.get());
+    if (read.is_eof()) {
+      codec_ctx.try_send_packet(nullptr);
+      auto received = codec_ctx.try_receive_frame(frm.get());
+      return received.has_value() && *received == send_receive_result::success;
+    }
+    read.value_or_throw(no_throw_nested());
+    packet_unref_guard guard{pkt};
+    if (static_cast<std::size_t>(pkt->stream_index) != stream_index ||
+        !codec_ctx.try_send_packet(pkt.get()).has_value()) {
+      continue;
+    }
+    auto received = codec_ctx.try_receive_frame(frm.get());
+    if (received.has_value() && *received == send_receive_result::success) {
+      return true;
+    }
+  }
+}
+} // namespace
+
+thumbnail_cache::thumbnail_cache(std::filesystem::path directory)
+    : m_directory{std::move(directory)} {}
+
+std::filesystem::path
+thumbnail_cache::entry_path(const file_identity &identity,
+                            const thumbnail_params &params) const {
+  return m_directory / fmt::format("{}-{}x{}.thumbs", identity.to_string(),
+                                   params.width, params.height);
+}
+
+std::vector<thumbnail>
+thumbnail_cache::load(const file_identity &identity,
+                      const thumbnail_params &params) const {
+  const auto data = read_file(entry_path(identity, params));
+  if (!data.has_value()) {
+    return {};
+  }
+
+  byte_reader reader{*data};
+  thumbnail_cache_header header;
+  if (!reader.read(header) || header.magic != thumbnail_cache_magic ||
+      header.version != thumbnail_cache_version ||
+      header.identity != identity || header.width != params.width ||
+      header.height != params.height) {
+    return {};
+  }
+
+  std::vector<thumbnail> result;
+  result.reserve(header.count);
+  for (std::uint32_t i = 0; i < header.count; ++i) {
+    thumbnail_record r{};
+    if (!reader.read(r) || r.width <= 0 || r.height <= 0) {
+      return {};
+    }
+    const auto pixels = reader.read_bytes(rgba_size(r.width, r.height));
+    if (!pixels.has_value()) {
+      return {};
+    }
+    const auto *begin = reinterpret_cast<const std::uint8_t *>(pixels->data());
+    result.push_back({
+        .timestamp = r.timestamp,
+        .frame_time = r.frame_time,
+        .width = r.width,
+        .height = r.height,
+        .rgba = {begin, begin + pixels->size()},
+    });
+  }
+  return result;
+}
+
+void thumbnail_cache::store(const file_identity &identity,
+                            const thumbnail_params &params,
+                            std::span<const thumbnail> thumbnails) const {
+  byte_writer writer;
+  writer.write(thumbnail_cache_header{
+      .identity = identity,
+      .width = params.width,
+      .height = params.height,
+      .count = static_cast<std::uint32_t>(thumbnails.size()),
+  });
+  for (const auto &thumb : thumbnails) {
+    writer.write(thumbnail_record{
+        .timestamp = thumb.timestamp,
+        .frame_time = thumb.frame_time,
+        .width = thumb.width,
+        .height = thumb.height,
+    });
+    writer.write_bytes(std::as_bytes(std::span{thumb.rgba}));
+  }
+
+  try {
+    write_file_atomic(entry_path(identity, params), writer.data());
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+}
+
+void thumbnail_cache::merge(const file_identity &identity,
+                            const thumbnail_params &params,
+                            std::span<const thumbnail> thumbnails) const {
+  std::lock_guard lock{m_merge_mutex};
+  std::map<std::int64_t, thumbnail> merged;
+  for (auto &thumb : load(identity, params)) {
+    merged.emplace(thumb.timestamp, std::move(thumb));
+  }
+  for (const auto &thumb : thumbnails) {
+    merged.insert_or_assign(thumb.timestamp, thumb);
+  }
+
+  std::vector<thumbnail> all;
+  all.reserve(merged.size());
+  for (auto &[ts, thumb] : merged) {
+    all.push_back(std::move(thumb));
+  }
+  store(identity, params, all);
+}
+
+thumbnailer::thumbnailer(thumbnail_params params, std::size_t workers,
+                         std::shared_ptr<const thumbnail_cache> cache)
+    : m_params{params}, m_cache{std::move(cache)} {
+  if (workers == 0) {
+    workers = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  for (std::size_t i = 0; i < workers; ++i) {
+    m_workers.emplace_back([this](std::stop_token stop) { run(stop); });
+  }
+}
+
+thumbnailer::~thumbnailer() {
+  for (auto &worker : m_workers) {
+    worker.request_stop();
+  }
+}
+
+thumbnailer_stats thumbnailer::stats() const {
+  std::lock_guard lock{m_mutex};
+  return m_stats;
+}
+
+std::future<std::vector<thumbnail>> thumbnailer::enqueue(job j) {
+  auto result = j.result.get_future();
+  {
+    std::lock_guard lock{m_mutex};
+    m_jobs.push_back(std::move(j));
+  }
+  m_job_ready.notify_one();
+  return result;
+}
+
+std::future<std::vector<thumbnail>>
+thumbnailer::request(std::string path, std::vector<std::int64_t> timestamps) {
+  return enqueue(
+      {.path = std::move(path), .timestamps = std::move(timestamps)});
+}
+
+std::future<std::vector<thumbnail>>
+thumbnailer::filmstrip(std::string path, std::size_t count) {
+  return enqueue({.path = std::move(path), .filmstrip_count = count});
+}
+
+void thumbnailer::run(std::stop_token stop) {
+  while (true) {
+    job j;
+    {
+      std::unique_lock lock{m_mutex};
+      if (!m_job_ready.wait(lock, stop, [&] { return !m_jobs.empty(); })) {
+        return;
+      }
+      j = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    try {
+      j.result.set_value(process(j));
+    } catch (...) {
+      j.result.set_exception(std::current_exception());
+    }
+  }
+}
+
+std::vector<thumbnail> thumbnailer::process(job &j) {
+  const auto identity = file_identity::of(j.path.c_str());
+  format_context format_ctx{j.path.c_str()};
+  const auto [stream_index, _] = format_ctx.find_stream(AVMEDIA_TYPE_VIDEO);
+  if (stream_index == format_context::npos) {
+    throw std::runtime_error{
+        fmt::format("No video stream to thumbnail in '{}'", j.path)};
+  }
+  const auto &st = *format_ctx.streams()[stream_index];
+
+  if (j.filmstrip_count != 0) {
+    const auto start =
+        format_ctx->start_time != AV_NOPTS_VALUE ? format_ctx->start_time : 0;
+    const auto duration = std::max<std::int64_t>(format_ctx->duration, 0);
+    const auto count = static_cast<std::int64_t>(j.filmstrip_count);
+    j.timestamps.clear();
+    for (std::int64_t i = 0; i < count; ++i) {
+      // The middle of each slot of the strip.
+      j.timestamps.push_back(start + duration * (2 * i + 1) / (2 * count));
+    }
+  }
+
+  std::map<std::int64_t, thumbnail> known;
+  for (auto &thumb : m_cache->load(identity, m_params)) {
+    known.emplace(thumb.timestamp, std::move(thumb));
+  }
+  std::vector<std::int64_t> missing;
+  for (const auto ts : j.timestamps) {
+    if (!known.contains(ts)) {
+      missing.push_back(ts);
+    }
+  }
+  const auto hits = j.timestamps.size() - missing.size();
+  std::sort(missing.begin(), missing.end());
+  missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+  std::size_t generated = 0;
+
+  if (!missing.empty()) {
+    codec_context codec_ctx{st};
+    // Parallelism comes from decoding several files at once.
+    codec_ctx.set_threading({threading_mode::slice, 1});
+    codec_ctx.set_preview_mode(preview_mode::keyframes_only);
+    codec_ctx.init();
+
+    scale_context scaler;
+    auto pkt = alloc_packet();
+    auto frm = alloc_frame();
+    const thumbnail *previous = nullptr;
+    for (const auto ts : missing) {
+      format_ctx.seek(stream_index, av_rescale_q(ts, time_base_q, st.time_base),
+                      AVSEEK_FLAG_BACKWARD);
+      codec_ctx.flush_buffers();
+      if (!decode_first(format_ctx, codec_ctx, stream_index, pkt, frm)) {
+        continue;
+      }
+      frame_unref_guard frame_guard{frm};
+
+      const auto timestamp = frame_timestamp(frm.get());
+      const auto frame_time =
+          timestamp == AV_NOPTS_VALUE
+              ? ts
+              : av_rescale_q(timestamp, st.time_base, time_base_q);
+      thumbnail thumb{.timestamp = ts, .frame_time = frame_time};
+      // Neighbouring timestamps often land on the same keyframe.
+      if (previous != nullptr && previous->frame_time == frame_time) {
+        thumb.width = previous->width;
+        thumb.height = previous->height;
+        thumb.rgba = previous->rgba;
+      } else {
+        thumb.width = m_params.width;
+        thumb.height = thumbnail_height(m_params, *frm);
+        thumb.rgba.resize(rgba_size(thumb.width, thumb.height));
+        std::uint8_t *const data[4]{thumb.rgba.data()};
+        const int linesize[4]{thumb.width * 4};
+        scaler.scale(*frm, thumb.width, thumb.height, AV_PIX_FMT_RGBA, data,
+                     linesize);
+      }
+      previous = &known.insert_or_assign(ts, std::move(thumb)).first->second;
+      ++generated;
+    }
+
+    // Another job for the same file may have stored since `load`, so only
+    // the new thumbnails are merged into what is on disk now.
+    std::vector<thumbnail> fresh;
+    fresh.reserve(generated);
+    for (const auto ts : missing) {
+      if (const auto it = known.find(ts); it != known.end()) {
+        fresh.push_back(it->second);
+      }
+    }
+    m_cache->merge(identity, m_params, fresh);
+  }
+
+  std::vector<thumbnail> result;
+  for (const auto ts : j.timestamps) {
+    if (const auto it = known.find(ts); it != known.end()) {
+      result.push_back(it->second);
+    }
+  }
+
+  std::lock_guard lock{m_mutex};
+  ++m_stats.files;
+  m_stats.cache_hits += hits;
+  m_stats.generated += generated;
+  return result;
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "disk_cache.hpp"
+#include "file_identity.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct thumbnail_params {
+  int width = 160;
+  // 0 follows the display aspect ratio of the video.
+  int height = 0;
+};
+
+struct thumbnail {
+  // Requested position, in AV_TIME_BASE units.
+  std::int64_t timestamp;
+  // Position of the keyframe actually shown, in AV_TIME_BASE units.
+  std::int64_t frame_time;
+  int width;
+  int height;
+  // Tightly packed RGBA rows.
+  std::vector<std::uint8_t> rgba;
+};
+
+// One file per source file and thumbnail size, holding every thumbnail
+// generated for it so far.
+class thumbnail_cache {
+public:
+  explicit thumbnail_cache(
+      std::filesystem::path directory = cache_directory("thumbnails"));
+
+  [[nodiscard]] std::vector<thumbnail>
+  load(const file_identity &identity, const thumbnail_params &params) const;
+  // Failures are logged, not thrown: the cache is only an optimisation.
+  void store(const file_identity &identity, const thumbnail_params &params,
+             std::span<const thumbnail> thumbnails) const;
+  // Adds `thumbnails` to the stored entry. Concurrent merges into the same
+  // entry are serialised so that none of them is lost.
+  void merge(const file_identity &identity, const thumbnail_params &params,
+             std::span<const thumbnail> thumbnails) const;
+
+private:
+  [[nodiscard]] std::filesystem::path
+  entry_path(const file_identity &identity,
+             const thumbnail_params &params) const;
+
+  std::filesystem::path m_directory;
+  mutable std::mutex m_merge_mutex;
+};
+
+struct thumbnailer_stats {
+  std::uint64_t generated = 0;
+  std::uint64_t cache_hits = 0;
+  std::uint64_t files = 0;
+};
+
+// Generates thumbnails for many files in parallel, one file per worker.
+// Only keyframes are decoded: each thumbnail shows the keyframe at or before
+// its timestamp.
+class thumbnailer {
+public:
+  explicit thumbnailer(thumbnail_params params = {}, std::size_t workers = 0,
+                       std::shared_ptr<const thumbnail_cache> cache =
+                           std::make_shared<const thumbnail_cache>());
+  ~thumbnailer();
+
+  thumbnailer(const thumbnailer &) = delete;
+  thumbnailer &operator=(const thumbnailer &) = delete;
+
+  // `timestamps` are in AV_TIME_BASE units.
+  [[nodiscard]] std::future<std::vector<thumbnail>>
+  request(std::string path, std::vector<std::int64_t> timestamps);
+  // `count` thumbnails spread evenly over the duration of `path`.
+  [[nodiscard]] std::future<std::vector<thumbnail>>
+  filmstrip(std::string path, std::size_t count);
+
+  [[nodiscard]] thumbnailer_stats stats() const;
+
+private:
+  struct job {
+    std::string path;
+    std::vector<std::int64_t> timestamps;
+    // Used instead of `timestamps` when non-zero.
+    std::size_t filmstrip_count = 0;
+    std::promise<std::vector<thumbnail>> result;
+  };
+
+  std::future<std::vector<thumbnail>> enqueue(job j);
+  void run(std::stop_token stop);
+  std::vector<thumbnail> process(job &j);
+
+  thumbnail_params m_params;
+  std::shared_ptr<const thumbnail_cache> m_cache;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable_any m_job_ready;
+  std::deque<job> m_jobs;
+  thumbnailer_stats m_stats;
+
+  std::vector<std::jthread> m_workers;
+};
+} // namespace libved::ffmpeg
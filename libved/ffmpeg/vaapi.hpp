@@ -1,5 +1,7 @@
 #pragma once
 
+#include "ffmpeg/pbo_uploader.hpp"
+#include "ffmpeg/pools.hpp"
 #include "ffmpeg/wrappers/avcodec.hpp"
 #include "ffmpeg/wrappers/avutil.hpp"
 #include "glad/egl.h"
@@ -35,7 +37,18 @@ private:
   std::array<staplegl::texture_2d, 2> m_textures;
 };
 
-using texture = std::variant<std::monostate, nv12_texture>;
+using texture = std::variant<std::monostate, nv12_texture, uploaded_texture>;
+
+inline void bind_units(texture &tex, std::uint32_t luma,
+                       std::uint32_t chroma) {
+  std::visit(
+      [&]<typename T>(T &t) {
+        if constexpr (!std::is_same_v<T, std::monostate>) {
+          t.bind_units(luma, chroma);
+        }
+      },
+      tex);
+}
 
 class fd_guard {
 public:
@@ -78,8 +91,9 @@ inline drm_prime_guard make_guard(const AVDRMFrameDescriptor &desc) {
   return guards;
 }
 
-inline guarded_texture map_nv12_frame(const ffmpeg::frame &hw_frame) {
-  auto drm_frame = ffmpeg::alloc_frame();
+inline guarded_texture map_nv12_frame(const ffmpeg::frame &hw_frame,
+                                      ffmpeg::frame_pool *pool = nullptr) {
+  auto drm_frame = pool != nullptr ? pool->get() : ffmpeg::alloc_frame();
   drm_frame->format = AV_PIX_FMT_DRM_PRIME;
   if (av_hwframe_map(drm_frame.get(), hw_frame.get(), 0)) {
     throw std::runtime_error("Couldn't map VAAPI hardware frame");
@@ -0,0 +1,432 @@
+#include "waveform.hpp"
+#include "wrappers/avcodec.hpp"
+#include "wrappers/swresample.hpp"
+#include <algorithm>
+#include <cmath>
+#include <errors.hpp>
+#include <fmt/core.h>
+#include <limits>
+#include <stdexcept>
+
+namespace libved::ffmpeg {
+namespace {
+constexpr std::uint32_t waveform_magic = 0x4657564c; // "LVWF"
+constexpr std::uint32_t waveform_version = 1;
+
+struct waveform_header {
+  std::uint32_t magic = waveform_magic;
+  std::uint32_t version = waveform_version;
+  file_identity identity;
+  std::uint32_t block_samples;
+  std::uint32_t fanout;
+  std::int32_t sample_rate;
+  std::uint32_t channels;
+  std::int64_t samples;
+  std::uint64_t level_count;
+};
+
+struct level_record {
+  std::uint64_t offset;
+  std::uint64_t count;
+};
+
+static_assert(sizeof(waveform_header) % alignof(level_record) == 0);
+static_assert(sizeof(level_record) % alignof(waveform_peak) == 0);
+
+struct peak_accumulator {
+  float min = std::numeric_limits<float>::max();
+  float max = std::numeric_limits<float>::lowest();
+  double square_sum = 0;
+  std::size_t count = 0;
+
+  void add_samples(const float *samples, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+      min = std::min(min, samples[i]);
+      max = std::max(max, samples[i]);
+      square_sum += static_cast<double>(samples[i]) * samples[i];
+    }
+    count += n;
+  }
+
+  void add_peak(const waveform_peak &p) {
+    min = std::min(min, p.min);
+    max = std::max(max, p.max);
+    square_sum += static_cast<double>(p.rms) * p.rms;
+    ++count;
+  }
+
+  [[nodiscard]] waveform_peak result() const {
+    if (count == 0) {
+      return {0, 0, 0};
+    }
+    return {min, max,
+            static_cast<float>(std::sqrt(square_sum /
+                                         static_cast<double>(count)))};
+  }
+};
+
+std::uint64_t div_ceil(std::uint64_t a, std::uint64_t b) {
+  return (a + b - 1) / b;
+}
+
+waveform_params normalized(waveform_params params) {
+  params.block_samples = std::max<std::uint32_t>(params.block_samples, 1);
+  params.fanout = std::max<std::uint32_t>(params.fanout, 2);
+  return params;
+}
+
+std::filesystem::path cache_file(const std::filesystem::path &directory,
+                                 const file_identity &identity,
+                                 const waveform_params &params) {
+  return directory / fmt::format("{}-{}x{}.peaks", identity.to_string(),
+                                 params.block_samples, params.fanout);
+}
+} // namespace
+
+void waveform::layout_levels(std::uint64_t finest_count) {
+  m_levels.clear();
+  std::uint64_t offset = 0;
+  auto count = finest_count;
+  while (true) {
+    m_levels.push_back({.offset = offset, .count = count});
+    offset += count * m_channels;
+    if (count <= 1) {
+      break;
+    }
+    count = div_ceil(count, m_params.fanout);
+  }
+}
+
+std::int64_t waveform::samples_per_peak(std::size_t level) const {
+  auto samples = static_cast<std::int64_t>(m_params.block_samples);
+  for (std::size_t i = 0; i < level; ++i) {
+    samples *= m_params.fanout;
+  }
+  return samples;
+}
+
+std::span<const waveform_peak> waveform::level(std::size_t level) const {
+  const auto &info = m_levels.at(level);
+  return m_peaks.subspan(info.offset, info.count * m_channels);
+}
+
+waveform waveform::build(const char *path, waveform_params params,
+                         std::size_t stream_index) {
+  params = normalized(params);
+  format_context format_ctx{path};
+  if (stream_index == format_context::npos) {
+    stream_index = std::get<0>(format_ctx.find_stream(AVMEDIA_TYPE_AUDIO));
+    if (stream_index == format_context::npos) {
+      throw std::runtime_error{
+          fmt::format("No audio stream to summarise in '{}'", path)};
+    }
+  }
+
+  const auto streams = format_ctx.streams();
+  for (std::size_t i = 0; i < streams.size(); ++i) {
+    streams[i]->discard = i == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+
+  const auto &st = *streams[stream_index];
+  codec_context codec_ctx{st};
+  codec_ctx.init();
+  const auto channels = std::clamp(st.codecpar->ch_layout.nb_channels, 1, 2);
+  resample_context resampler{st.codecpar->sample_rate, channels};
+
+  waveform result;
+  result.m_params = params;
+  result.m_sample_rate = st.codecpar->sample_rate;
+  result.m_channels = static_cast<std::size_t>(channels);
+
+  std::vector<waveform_peak> peaks;
+  std::vector<peak_accumulator> blocks(result.m_channels);
+  std::uint32_t in_block = 0;
+  const auto finish_block = [&] {
+    for (auto &block : blocks) {
+      peaks.push_back(block.result());
+      block = {};
+    }
+    in_block = 0;
+  };
+  const auto add = [&](const audio_block &block) {
+    const auto n = static_cast<std::size_t>(block.samples);
+    std::size_t done = 0;
+    while (done < n) {
+      const auto take =
+          std::min<std::size_t>(n - done, params.block_samples - in_block);
+      for (std::size_t c = 0; c < blocks.size(); ++c) {
+        blocks[c].add_samples(block.planes[c] + done, take);
+      }
+      done += take;
+      in_block += static_cast<std::uint32_t>(take);
+      if (in_block == params.block_samples) {
+        finish_block();
+      }
+    }
+    result.m_samples += block.samples;
+  };
+
+  auto frm = alloc_frame();
+  const auto drain = [&] {
+    while (true) {
+      auto received = codec_ctx.try_receive_frame(frm.get());
+      if (!received.has_value() ||
+          *received != send_receive_result::success) {
+        return;
+      }
+      frame_unref_guard guard{frm};
+      add(resampler.convert(*frm));
+    }
+  };
+
+  for (auto &&[pkt, guard] : format_ctx.read_frames()) {
+    if (static_cast<std::size_t>((*pkt)->stream_index) != stream_index) {
+      continue;
+    }
+    while (true) {
+      // Corrupt packets only cost their own samples.
+      const auto sent = codec_ctx.try_send_packet(pkt->get());
+      drain();
+      if (!sent.has_value() || *sent != send_receive_result::eagain) {
+        break;
+      }
+    }
+  }
+  codec_ctx.try_send_packet(nullptr);
+  drain();
+  add(resampler.flush());
+  if (in_block > 0) {
+    finish_block();
+  }
+
+  // Each coarser level summarises `fanout` peaks of the level below.
+  result.layout_levels(peaks.size() / result.m_channels);
+  peaks.resize(result.m_levels.back().offset +
+               result.m_levels.back().count * result.m_channels);
+  for (std::size_t l = 1; l < result.m_levels.size(); ++l) {
+    const auto &below = result.m_levels[l - 1];
+    const auto &level = result.m_levels[l];
+    for (std::uint64_t i = 0; i < level.count; ++i) {
+      const auto first = i * params.fanout;
+      const auto last = std::min(first + params.fanout, below.count);
+      for (std::size_t c = 0; c < result.m_channels; ++c) {
+        peak_accumulator acc;
+        for (auto j = first; j < last; ++j) {
+          acc.add_peak(peaks[below.offset + j * result.m_channels + c]);
+        }
+        peaks[level.offset + i * result.m_channels + c] = acc.result();
+      }
+    }
+  }
+
+  const auto &stored =
+      result.m_storage.emplace<std::vector<waveform_peak>>(std::move(peaks));
+  result.m_peaks = stored;
+  return result;
+}
+
+tl::optional<waveform> waveform::load(const std::filesystem::path &file,
+                                      const file_identity &identity,
+                                      const waveform_params &params) {
+  std::shared_ptr<mapped_file> mapping;
+  try {
+    mapping = std::make_shared<mapped_file>(file.c_str());
+  } catch (std::exception &) {
+    return tl::nullopt;
+  }
+
+  const auto expected = normalized(params);
+  waveform_header header{};
+  byte_reader reader{mapping->bytes()};
+  if (!reader.read(header) || header.magic != waveform_magic ||
+      header.version != waveform_version || header.identity != identity ||
+      header.block_samples != expected.block_samples ||
+      header.fanout != expected.fanout || header.channels == 0 ||
+      header.level_count == 0) {
+    return tl::nullopt;
+  }
+
+  waveform result;
+  result.m_params = expected;
+  result.m_sample_rate = header.sample_rate;
+  result.m_channels = header.channels;
+  result.m_samples = header.samples;
+  for (std::uint64_t i = 0; i < header.level_count; ++i) {
+    level_record record{};
+    if (!reader.read(record)) {
+      return tl::nullopt;
+    }
+    result.m_levels.push_back({.offset = record.offset, .count = record.count});
+  }
+
+  const auto &last = result.m_levels.back();
+  const auto peak_count = last.offset + last.count * result.m_channels;
+  const auto peaks_offset = sizeof(waveform_header) +
+                            header.level_count * sizeof(level_record);
+  if (mapping->size() != peaks_offset + peak_count * sizeof(waveform_peak)) {
+    return tl::nullopt;
+  }
+
+  // The header and level table keep the peaks aligned within the
+  // page-aligned mapping.
+  const auto *peaks = reinterpret_cast<const waveform_peak *>(
+      mapping->data() + peaks_offset);
+  result.m_peaks = std::span{peaks, peak_count};
+  result.m_storage = std::move(mapping);
+  return result;
+}
+
+void waveform::save(const std::filesystem::path &file,
+                    const file_identity &identity) const {
+  byte_writer writer;
+  writer.write(waveform_header{
+      .identity = identity,
+      .block_samples = m_params.block_samples,
+      .fanout = m_params.fanout,
+      .sample_rate = m_sample_rate,
+      .channels = static_cast<std::uint32_t>(m_channels),
+      .samples = m_samples,
+      .level_count = m_levels.size(),
+  });
+  for (const auto &level : m_levels) {
+    writer.write(level_record{.offset = level.offset, .count = level.count});
+  }
+  writer.write_bytes(std::as_bytes(m_peaks));
+  write_file_atomic(file, writer.data());
+}
+
+waveform waveform::load_or_build(const char *path, waveform_params params,
+                                 const std::filesystem::path &directory) {
+  params = normalized(params);
+  const auto identity = file_identity::of(path);
+  const auto file = cache_file(directory, identity, params);
+  if (auto result = load(file, identity, params); result.has_value()) {
+    return std::move(*result);
+  }
+
+  auto result = build(path, params);
+  try {
+    result.save(file, identity);
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+  return result;
+}
+
+void waveform::query(std::size_t channel, std::int64_t begin,
+                     std::int64_t end, std::span<waveform_peak> out) const {
+  if (out.empty()) {
+    return;
+  }
+  if (channel >= m_channels || end <= begin || m_levels.empty()) {
+    std::fill(out.begin(), out.end(), waveform_peak{0, 0, 0});
+    return;
+  }
+
+  // The coarsest level whose peaks are no wider than a column.
+  const auto columns = static_cast<std::int64_t>(out.size());
+  const auto column_samples =
+      std::max<std::int64_t>((end - begin) / columns, 1);
+  std::size_t l = 0;
+  while (l + 1 < m_levels.size() && samples_per_peak(l + 1) <= column_samples) {
+    ++l;
+  }
+
+  const auto &level = m_levels[l];
+  const auto peak_samples = samples_per_peak(l);
+  const auto count = static_cast<std::int64_t>(level.count);
+  const auto *peaks = m_peaks.data() + level.offset;
+  for (std::int64_t i = 0; i < columns; ++i) {
+    const auto from = begin + (end - begin) * i / columns;
+    const auto to = begin + (end - begin) * (i + 1) / columns;
+    peak_accumulator acc;
+    if (to <= 0) {
+      out[static_cast<std::size_t>(i)] = acc.result();
+      continue;
+    }
+    const auto first = std::max<std::int64_t>(from, 0) / peak_samples;
+    const auto last = std::min(
+        std::max((to + peak_samples - 1) / peak_samples, first + 1), count);
+    for (auto j = first; j < last; ++j) {
+      acc.add_peak(peaks[j * static_cast<std::int64_t>(m_channels) +
+                         static_cast<std::int64_t>(channel)]);
+    }
+    out[static_cast<std::size_t>(i)] = acc.result();
+  }
+}
+
+waveform_builder::waveform_builder(waveform_params params,
+                                   std::size_t workers,
+                                   std::filesystem::path directory)
+    : m_params{normalized(params)}, m_directory{std::move(directory)} {
+  if (workers == 0) {
+    workers = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  for (std::size_t i = 0; i < workers; ++i) {
+    m_workers.emplace_back([this](std::stop_token stop) { run(stop); });
+  }
+}
+
+waveform_builder::~waveform_builder() {
+  for (auto &worker : m_workers) {
+    worker.request_stop();
+  }
+}
+
+waveform_builder_stats waveform_builder::stats() const {
+  std::lock_guard lock{m_mutex};
+  return m_stats;
+}
+
+std::future<waveform> waveform_builder::request(std::string path) {
+  job j{.path = std::move(path)};
+  auto result = j.result.get_future();
+  {
+    std::lock_guard lock{m_mutex};
+    m_jobs.push_back(std::move(j));
+  }
+  m_job_ready.notify_one();
+  return result;
+}
+
+void waveform_builder::run(std::stop_token stop) {
+  while (true) {
+    job j;
+    {
+      std::unique_lock lock{m_mutex};
+      if (!m_job_ready.wait(lock, stop, [&] { return !m_jobs.empty(); })) {
+        return;
+      }
+      j = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    try {
+      j.result.set_value(process(j));
+    } catch (...) {
+      j.result.set_exception(std::current_exception());
+    }
+  }
+}
+
+waveform waveform_builder::process(const job &j) {
+  const auto identity = file_identity::of(j.path.c_str());
+  const auto file = cache_file(m_directory, identity, m_params);
+  if (auto cached = waveform::load(file, identity, m_params);
+      cached.has_value()) {
+    std::lock_guard lock{m_mutex};
+    ++m_stats.cache_hits;
+    return std::move(*cached);
+  }
+
+  auto result = waveform::build(j.path.c_str(), m_params);
+  try {
+    result.save(file, identity);
+  } catch (std::exception &ex) {
+    log_exception(ex);
+  }
+  std::lock_guard lock{m_mutex};
+  ++m_stats.built;
+  return result;
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "disk_cache.hpp"
+#include "file_identity.hpp"
+#include "mapped_file.hpp"
+#include "wrappers/avformat.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <tl/optional.hpp>
+#include <variant>
+#include <vector>
+
+namespace libved::ffmpeg {
+struct waveform_peak {
+  float min;
+  float max;
+  float rms;
+};
+
+struct waveform_params {
+  // Samples summarised by each peak of the finest level.
+  std::uint32_t block_samples = 256;
+  // Peaks of one level summarised by each peak of the next coarser one.
+  std::uint32_t fanout = 4;
+
+  bool operator==(const waveform_params &) const = default;
+};
+
+// Min/max/RMS summaries of one audio stream at a pyramid of resolutions,
+// built by decoding the stream once. Like seek_index, the on-disk format is
+// a fixed header, a level table and the peaks, so a saved pyramid is used
+// straight from its mapping.
+class waveform {
+public:
+  waveform(waveform &&) = default;
+  waveform &operator=(waveform &&) = default;
+  waveform(const waveform &) = delete;
+  waveform &operator=(const waveform &) = delete;
+
+  [[nodiscard]] static waveform
+  build(const char *path, waveform_params params = {},
+        std::size_t stream_index = format_context::npos);
+  [[nodiscard]] static tl::optional<waveform>
+  load(const std::filesystem::path &file, const file_identity &identity,
+       const waveform_params &params);
+  void save(const std::filesystem::path &file,
+            const file_identity &identity) const;
+
+  // Loads the pyramid of `path` from `directory`, building and saving it
+  // first if it is missing or stale.
+  [[nodiscard]] static waveform
+  load_or_build(const char *path, waveform_params params = {},
+                const std::filesystem::path &directory =
+                    cache_directory("waveforms"));
+
+  [[nodiscard]] int sample_rate() const noexcept { return m_sample_rate; }
+  [[nodiscard]] std::size_t channels() const noexcept { return m_channels; }
+  // Length of the stream, in samples per channel.
+  [[nodiscard]] std::int64_t samples() const noexcept { return m_samples; }
+  [[nodiscard]] const waveform_params &params() const noexcept {
+    return m_params;
+  }
+
+  [[nodiscard]] std::size_t level_count() const noexcept {
+    return m_levels.size();
+  }
+  [[nodiscard]] std::int64_t samples_per_peak(std::size_t level) const;
+  // Peaks of `level`, channels interleaved.
+  [[nodiscard]] std::span<const waveform_peak> level(std::size_t level) const;
+
+  // Summarises samples [begin, end) of `channel` into out.size() equal
+  // columns, e.g. one per pixel. Reads at most fanout + 2 peaks per column
+  // from the coarsest level that still resolves it, so the cost depends on
+  // the number of columns, not on the zoom. Columns narrower than
+  // block_samples repeat the peak that covers them.
+  void query(std::size_t channel, std::int64_t begin, std::int64_t end,
+             std::span<waveform_peak> out) const;
+
+private:
+  struct level_info {
+    // In peaks from the start of the peak data, counting every channel.
+    std::uint64_t offset;
+    std::uint64_t count;
+  };
+
+  waveform() = default;
+  // Fills m_levels from the finest level's peak count.
+  void layout_levels(std::uint64_t finest_count);
+
+  waveform_params m_params;
+  int m_sample_rate = 0;
+  std::size_t m_channels = 0;
+  std::int64_t m_samples = 0;
+  std::vector<level_info> m_levels;
+  std::variant<std::vector<waveform_peak>, std::shared_ptr<mapped_file>>
+      m_storage;
+  std::span<const waveform_peak> m_peaks;
+};
+
+struct waveform_builder_stats {
+  std::uint64_t built = 0;
+  std::uint64_t cache_hits = 0;
+};
+
+// Loads or builds the waveforms of many files in parallel, one file per
+// worker.
+class waveform_builder {
+public:
+  explicit waveform_builder(
+      waveform_params params = {}, std::size_t workers = 0,
+      std::filesystem::path directory = cache_directory("waveforms"));
+  ~waveform_builder();
+
+  waveform_builder(const waveform_builder &) = delete;
+  waveform_builder &operator=(const waveform_builder &) = delete;
+
+  [[nodiscard]] std::future<waveform> request(std::string path);
+
+  [[nodiscard]] waveform_builder_stats stats() const;
+
+private:
+  struct job {
+    std::string path;
+    std::promise<waveform> result;
+  };
+
+  void run(std::stop_token stop);
+  waveform process(const job &j);
+
+  waveform_params m_params;
+  std::filesystem::path m_directory;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable_any m_job_ready;
+  std::deque<job> m_jobs;
+  waveform_builder_stats m_stats;
+
+  std::vector<std::jthread> m_workers;
+};
+} // namespace libved::ffmpeg
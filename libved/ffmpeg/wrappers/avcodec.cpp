@@ -1,7 +1,10 @@
 #include "avcodec.hpp"
+#include "ffmpeg/pools.hpp"
 #include "ffmpeg/wrappers/common.hpp"
+#include <algorithm>
 #include <errors.hpp>
 #include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
 #include <new>
 #include <spdlog/spdlog.h>
 #include <unordered_set>
@@ -14,7 +17,16 @@ template <typename T> inline tl::optional<T &> optional_ref_from_ptr(T *ptr) {
 packet alloc_packet() { return call_alloc(no_throw_nested(), av_packet_alloc); }
 
 packet::packet(AVPacket *p) : std::unique_ptr<AVPacket, packet_deleter>{p} {}
-void packet_deleter::operator()(AVPacket *p) { av_packet_free(&p); }
+packet::packet(AVPacket *p, std::shared_ptr<recycler<AVPacket>> pool)
+    : std::unique_ptr<AVPacket, packet_deleter>{
+          p, packet_deleter{std::move(pool)}} {}
+void packet_deleter::operator()(AVPacket *p) {
+  if (pool != nullptr) {
+    pool->recycle(p);
+  } else {
+    av_packet_free(&p);
+  }
+}
 packet_unref_guard::packet_unref_guard(AVPacket *f) : m_packet{f} {}
 packet_unref_guard::packet_unref_guard(const packet &f)
     : packet_unref_guard{f.get()} {}
@@ -32,6 +44,26 @@ packet_unref_guard &packet_unref_guard::operator=(packet_unref_guard &&other) {
   return *this;
 }
 
+codec_params_ptr::codec_params_ptr(AVCodecParameters *p)
+    : std::unique_ptr<AVCodecParameters, codec_params_deleter>{p} {}
+void codec_params_deleter::operator()(AVCodecParameters *p) {
+  avcodec_parameters_free(&p);
+}
+
+codec_params_ptr alloc_codec_params() {
+  return call_alloc(
+      throw_nested_runtime_error("Unable to allocate AVCodecParameters"),
+      avcodec_parameters_alloc);
+}
+
+codec_params_ptr copy_codec_params(const codec_params &params) {
+  auto copy = alloc_codec_params();
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to copy AVCodecParameters"),
+      avcodec_parameters_copy, copy.get(), &params);
+  return copy;
+}
+
 tl::optional<const codec &> find_decoder(codec_id id) {
   return optional_ref_from_ptr(avcodec_find_decoder(id));
 }
@@ -71,7 +103,9 @@ codec_context::codec_context(const codec_params &params,
     : codec_context{params.codec_id, type, &params} {}
 
 codec_context::codec_context(const stream &stream, codec_context_type type)
-    : codec_context{*stream.codecpar, type} {}
+    : codec_context{*stream.codecpar, type} {
+  get()->pkt_timebase = stream.time_base;
+}
 
 void codec_context_deleter::operator()(AVCodecContext *c) {
   avcodec_free_context(&c);
@@ -89,14 +123,100 @@ codec_context::codec_context(const codec &codec, const codec_params *params)
   }
 }
 
+void codec_context::set_threading(const threading_policy &policy) {
+  switch (policy.mode) {
+  case threading_mode::automatic:
+    get()->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    break;
+  case threading_mode::frame:
+    get()->thread_type = FF_THREAD_FRAME;
+    break;
+  case threading_mode::slice:
+    get()->thread_type = FF_THREAD_SLICE;
+    break;
+  }
+  get()->thread_count = policy.thread_count;
+}
+
+threading_policy codec_context::active_threading() const {
+  const auto type = get()->active_thread_type;
+  return {
+      .mode = type == FF_THREAD_FRAME   ? threading_mode::frame
+              : type == FF_THREAD_SLICE ? threading_mode::slice
+                                        : threading_mode::automatic,
+      .thread_count = type == 0 ? 1 : get()->thread_count,
+  };
+}
+
+static int pooled_get_buffer2(AVCodecContext *ctx, AVFrame *frm, int flags) {
+  // Audio frames carry an AVSampleFormat, not a pixel format.
+  if (ctx->codec_type != AVMEDIA_TYPE_VIDEO) {
+    return avcodec_default_get_buffer2(ctx, frm, flags);
+  }
+  auto *pool = static_cast<frame_pool *>(ctx->opaque);
+  const auto *desc =
+      av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frm->format));
+  if (pool == nullptr || desc == nullptr ||
+      (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+      ctx->hw_frames_ctx != nullptr ||
+      !(ctx->codec->capabilities & AV_CODEC_CAP_DR1)) {
+    return avcodec_default_get_buffer2(ctx, frm, flags);
+  }
+
+  int width = frm->width;
+  int height = frm->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+  try {
+    pool->allocate_buffers(frm, width, height);
+  } catch (std::exception &ex) {
+    log_exception(ex);
+    return AVERROR(ENOMEM);
+  }
+  return 0;
+}
+
+void codec_context::set_frame_pool(std::shared_ptr<frame_pool> pool) {
+  m_frame_pool = std::move(pool);
+  get()->opaque = m_frame_pool.get();
+  get()->get_buffer2 = m_frame_pool != nullptr ? pooled_get_buffer2
+                                               : avcodec_default_get_buffer2;
+}
+
+void codec_context::set_preview_mode(preview_mode mode, int lowres) {
+  auto *ctx = get();
+  ctx->skip_loop_filter =
+      mode == preview_mode::full ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  ctx->skip_idct =
+      mode == preview_mode::full ? AVDISCARD_DEFAULT : AVDISCARD_NONREF;
+  switch (mode) {
+  case preview_mode::full:
+  case preview_mode::fast:
+    ctx->skip_frame = AVDISCARD_DEFAULT;
+    break;
+  case preview_mode::no_b_frames:
+    ctx->skip_frame = AVDISCARD_BIDIR;
+    break;
+  case preview_mode::keyframes_only:
+    ctx->skip_frame = AVDISCARD_NONKEY;
+    break;
+  }
+  if (!avcodec_is_open(ctx)) {
+    ctx->lowres =
+        std::clamp(lowres, 0, static_cast<int>(ctx->codec->max_lowres));
+  }
+  m_preview_mode = mode;
+}
+
 void codec_context::init() {
   call_and_handle_error(
       throw_nested_runtime_error("Unable to open AVCodecContext"),
       avcodec_open2, get(), get()->codec, nullptr);
 }
 
-template <std::invocable<> NestedThrowCallback>
-static auto to_send_recv_result(int ret, NestedThrowCallback &&callback) {
+void codec_context::flush_buffers() { avcodec_flush_buffers(get()); }
+
+static av_expected<send_receive_result> to_send_recv_result(int ret) noexcept {
   if (ret == AVERROR(EAGAIN)) {
     return send_receive_result::eagain;
   }
@@ -105,30 +225,44 @@ static auto to_send_recv_result(int ret, NestedThrowCallback &&callback) {
     return send_receive_result::eof;
   }
 
-  check_error(std::forward<NestedThrowCallback>(callback), ret);
+  if (ret < 0) {
+    return av_unexpected{ret};
+  }
+
   return send_receive_result::success;
 }
 
+av_expected<send_receive_result>
+codec_context::try_receive_frame(AVFrame *frame) noexcept {
+  return to_send_recv_result(avcodec_receive_frame(get(), frame));
+}
+av_expected<send_receive_result>
+codec_context::try_send_frame(const AVFrame *frame) noexcept {
+  return to_send_recv_result(avcodec_send_frame(get(), frame));
+}
+av_expected<send_receive_result>
+codec_context::try_receive_packet(AVPacket *packet) noexcept {
+  return to_send_recv_result(avcodec_receive_packet(get(), packet));
+}
+av_expected<send_receive_result>
+codec_context::try_send_packet(const AVPacket *packet) noexcept {
+  return to_send_recv_result(avcodec_send_packet(get(), packet));
+}
+
 send_receive_result codec_context::receive_frame(AVFrame *frame) {
-  return to_send_recv_result(
-      avcodec_receive_frame(get(), frame),
-      throw_nested_runtime_error(
-          "Unable to receive frame from AVCodecContext"));
+  return try_receive_frame(frame).value_or_throw(throw_nested_runtime_error(
+      "Unable to receive frame from AVCodecContext"));
 }
 send_receive_result codec_context::send_frame(const AVFrame *frame) {
-  return to_send_recv_result(
-      avcodec_send_frame(get(), frame),
-      throw_nested_runtime_error("Unable to receive frame to AVCodecContext"));
+  return try_send_frame(frame).value_or_throw(
+      throw_nested_runtime_error("Unable to send frame to AVCodecContext"));
 }
 send_receive_result codec_context::receive_packet(AVPacket *packet) {
-  return to_send_recv_result(
-      avcodec_receive_packet(get(), packet),
-      throw_nested_runtime_error(
-          "Unable to receive packet from AVCodecContext"));
+  return try_receive_packet(packet).value_or_throw(throw_nested_runtime_error(
+      "Unable to receive packet from AVCodecContext"));
 }
 send_receive_result codec_context::send_packet(const AVPacket *packet) {
-  return to_send_recv_result(
-      avcodec_send_packet(get(), packet),
+  return try_send_packet(packet).value_or_throw(
       throw_nested_runtime_error("Unable to send packet to AVCodecContext"));
 }
 
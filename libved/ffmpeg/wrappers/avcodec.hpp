@@ -22,13 +22,17 @@ using stream = AVStream;
 using hw_config = const AVCodecHWConfig *;
 using hwdevice_type = AVHWDeviceType;
 
+class frame_pool;
+
 struct packet_deleter {
+  std::shared_ptr<recycler<AVPacket>> pool;
   void operator()(AVPacket *p);
 };
 
 class packet : public std::unique_ptr<AVPacket, packet_deleter> {
 public:
   packet(AVPacket *packet = nullptr);
+  packet(AVPacket *packet, std::shared_ptr<recycler<AVPacket>> pool);
 };
 
 [[nodiscard]] packet alloc_packet();
@@ -49,6 +53,19 @@ private:
   AVPacket *m_packet;
 };
 
+struct codec_params_deleter {
+  void operator()(AVCodecParameters *p);
+};
+
+class codec_params_ptr
+    : public std::unique_ptr<AVCodecParameters, codec_params_deleter> {
+public:
+  codec_params_ptr(AVCodecParameters *p = nullptr);
+};
+
+[[nodiscard]] codec_params_ptr alloc_codec_params();
+[[nodiscard]] codec_params_ptr copy_codec_params(const codec_params &params);
+
 [[nodiscard]] tl::optional<const codec &> find_decoder(codec_id id);
 [[nodiscard]] tl::optional<const codec &> find_encoder(codec_id id);
 
@@ -67,6 +84,34 @@ enum class codec_context_type {
   encode,
 };
 
+enum class threading_mode {
+  // Frame and slice threading, whichever the codec supports.
+  automatic,
+  // Decodes several frames at once. Best throughput, but adds a frame of
+  // delay per thread.
+  frame,
+  // Splits each frame between threads. No extra delay.
+  slice,
+};
+
+struct threading_policy {
+  threading_mode mode = threading_mode::automatic;
+  // 0 lets FFmpeg pick from the number of CPUs; 1 disables threading.
+  int thread_count = 0;
+
+  bool operator==(const threading_policy &) const = default;
+};
+
+enum class preview_mode {
+  full,
+  // Skips the loop filter everywhere and the IDCT of non-reference frames.
+  fast,
+  // `fast`, and B-frames are not decoded at all.
+  no_b_frames,
+  // Only keyframes are decoded.
+  keyframes_only,
+};
+
 class codec_context
     : public std::unique_ptr<AVCodecContext, codec_context_deleter> {
 public:
@@ -79,7 +124,40 @@ public:
   codec_context(const stream &stream,
                 codec_context_type type = codec_context_type::decode);
 
+  // Only takes effect if called before init().
+  void set_threading(const threading_policy &policy);
+  // The threading FFmpeg actually chose, once init() has been called.
+  [[nodiscard]] threading_policy active_threading() const;
+
+  // Makes the decoder allocate frame planes from `pool` instead of its own
+  // buffers, so that frames can be uploaded or processed without another
+  // copy. Audio decoders, decoders without direct rendering support,
+  // hardware frames and paletted formats keep the default allocator. Must be
+  // called before init().
+  void set_frame_pool(std::shared_ptr<frame_pool> pool);
+
+  // Trades quality for decoding speed, e.g. while scrubbing. Takes effect
+  // with the next packet; when skipping less than before, call
+  // flush_buffers() or seek so that no frame references a skipped one.
+  // `lowres` (a power-of-two downscale, clamped to what the decoder
+  // supports) can only be applied before init() and is ignored afterwards.
+  void set_preview_mode(preview_mode mode, int lowres = 0);
+  [[nodiscard]] preview_mode current_preview_mode() const noexcept {
+    return m_preview_mode;
+  }
+
   void init();
+  void flush_buffers();
+
+  // Non-throwing variants. EAGAIN and EOF are reported as values, any other
+  // failure as the AVERROR code.
+  av_expected<send_receive_result>
+  try_send_frame(const AVFrame *frame) noexcept;
+  av_expected<send_receive_result> try_receive_frame(AVFrame *frame) noexcept;
+  av_expected<send_receive_result>
+  try_send_packet(const AVPacket *packet) noexcept;
+  av_expected<send_receive_result>
+  try_receive_packet(AVPacket *packet) noexcept;
 
   send_receive_result send_frame(const AVFrame *frame);
   send_receive_result receive_frame(AVFrame *frame);
@@ -106,6 +184,10 @@ public:
 
   void set_format_callback(
       AVPixelFormat (*format_callback)(AVCodecContext *, const AVPixelFormat *));
+
+private:
+  std::shared_ptr<frame_pool> m_frame_pool;
+  preview_mode m_preview_mode = preview_mode::full;
 };
 
 inline cppcoro::generator<hwdevice_type> hwdevice_types() {
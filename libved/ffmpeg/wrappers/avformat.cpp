@@ -22,16 +22,44 @@ void format_context_deleter::operator()(AVFormatContext *c) {
   avformat_close_input(&c);
 }
 
-format_context::format_context(const char *input) {
+format_context::format_context(const char *input, probe_mode mode,
+                               const AVInputFormat *input_format) {
   AVFormatContext *c = nullptr;
   call_and_handle_error(
       throw_nested_runtime_error("Unable to open input at url '{}'", input),
-      avformat_open_input, &c, input, nullptr, nullptr);
+      avformat_open_input, &c, input, input_format, nullptr);
   reset(c);
+  if (mode == probe_mode::full) {
+    find_stream_info();
+  }
+}
 
+format_context::format_context(std::unique_ptr<io_backend> io, const char *url,
+                               probe_mode mode)
+    : m_io{std::move(io)} {
+  AVFormatContext *c = call_alloc(
+      throw_nested_runtime_error("Unable to allocate AVFormatContext"),
+      avformat_alloc_context);
+  c->pb = m_io->avio_context();
+  c->flags |= AVFMT_FLAG_CUSTOM_IO;
+  // avformat_open_input frees the context on failure.
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to open custom input '{}'",
+                                 url != nullptr ? url : ""),
+      avformat_open_input, &c, url, nullptr, nullptr);
+  reset(c);
+  if (mode == probe_mode::full) {
+    find_stream_info();
+  }
+}
+
+// The AVIOContext of a custom input must outlive the AVFormatContext.
+format_context::~format_context() { reset(); }
+
+void format_context::find_stream_info() {
   call_and_handle_error(
       throw_nested_runtime_error("Unable to find stream info"),
-      avformat_find_stream_info, c, nullptr);
+      avformat_find_stream_info, get(), nullptr);
 }
 
 [[nodiscard]] std::span<AVStream *> format_context::streams() const noexcept {
@@ -49,9 +77,102 @@ format_context::find_stream(AVMediaType media_type,
   return std::make_tuple(int_to_size_t(index), codec);
 }
 
+void format_context::seek(std::size_t stream_index, std::int64_t timestamp,
+                          int flags) {
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to seek stream {} to {}",
+                                 static_cast<int>(size_t_to_int(stream_index)),
+                                 timestamp),
+      av_seek_frame, get(), static_cast<int>(size_t_to_int(stream_index)),
+      timestamp, flags);
+}
+
+av_expected<void> format_context::try_read_frame(AVPacket *pkt) noexcept {
+  return to_expected(av_read_frame(get(), pkt));
+}
+
 packet_unref_guard format_context::read_frame(AVPacket *pkt) {
-  call_and_handle_error(no_throw_nested(), av_read_frame, get(), pkt);
+  try_read_frame(pkt).value_or_throw(no_throw_nested());
   return packet_unref_guard{pkt};
 }
 
+void output_format_context_deleter::operator()(AVFormatContext *c) {
+  if (!(c->oformat->flags & AVFMT_NOFILE)) {
+    avio_closep(&c->pb);
+  }
+  avformat_free_context(c);
+}
+
+output_format_context::output_format_context(const char *url,
+                                             const char *format_name) {
+  AVFormatContext *c = nullptr;
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to create output for url '{}'", url),
+      avformat_alloc_output_context2, &c, nullptr, format_name, url);
+  reset(c);
+}
+
+void output_format_context::prepare_encoder(codec_context &encoder) const {
+  if (get()->oformat->flags & AVFMT_GLOBALHEADER) {
+    encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+}
+
+std::size_t output_format_context::add_stream(const codec_context &encoder) {
+  auto *st = call_alloc(
+      throw_nested_runtime_error("Unable to allocate output AVStream"),
+      avformat_new_stream, get(), nullptr);
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to copy encoder parameters"),
+      avcodec_parameters_from_context, st->codecpar, encoder.get());
+  // Only a hint: the muxer picks the time base it can represent.
+  st->time_base = encoder->time_base;
+  if (encoder->codec_type == AVMEDIA_TYPE_VIDEO) {
+    st->avg_frame_rate = encoder->framerate;
+  }
+  return static_cast<std::size_t>(st->index);
+}
+
+void output_format_context::write_header() {
+  auto *c = get();
+  if (!(c->oformat->flags & AVFMT_NOFILE)) {
+    call_and_handle_error(
+        throw_nested_runtime_error("Unable to open output '{}'", c->url),
+        avio_open, &c->pb, c->url, AVIO_FLAG_WRITE);
+  }
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to write header of '{}'", c->url),
+      avformat_write_header, c, nullptr);
+}
+
+av_expected<void>
+output_format_context::try_write_packet(AVPacket *pkt,
+                                        std::size_t stream_index,
+                                        AVRational time_base) noexcept {
+  pkt->stream_index = static_cast<int>(stream_index);
+  av_packet_rescale_ts(pkt, time_base,
+                       get()->streams[stream_index]->time_base);
+  return to_expected(av_interleaved_write_frame(get(), pkt));
+}
+
+void output_format_context::write_packet(AVPacket *pkt,
+                                         std::size_t stream_index,
+                                         AVRational time_base) {
+  try_write_packet(pkt, stream_index, time_base)
+      .value_or_throw(throw_nested_runtime_error(
+          "Unable to write packet of stream {}",
+          static_cast<int>(stream_index)));
+}
+
+void output_format_context::write_trailer() {
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to write trailer of '{}'",
+                                 get()->url),
+      av_write_trailer, get());
+}
+
+std::span<AVStream *> output_format_context::streams() const noexcept {
+  return std::span{get()->streams, get()->nb_streams};
+}
+
 } // namespace libved::ffmpeg
@@ -6,10 +6,12 @@ extern "C" {
 }
 
 #include "avcodec.hpp"
+#include "avio.hpp"
 #include "common.hpp"
 #include <coroutine>
 #include <cppcoro/generator.hpp>
 #include <functional>
+#include <memory>
 #include <span>
 
 namespace libved::ffmpeg {
@@ -25,11 +27,31 @@ struct packet_ref {
   packet &operator*() const { return *this->pkt; }
 };
 
+enum class probe_mode {
+  // Run avformat_find_stream_info after opening.
+  full,
+  // Only read the container header. Stream parameters that the header does
+  // not carry stay unset until find_stream_info() is called.
+  header_only,
+};
+
 class format_context
     : public std::unique_ptr<AVFormatContext, format_context_deleter> {
 public:
   static constexpr std::size_t npos = static_cast<std::size_t>(-1);
-  format_context(const char *input = nullptr);
+  // A known `input_format` skips container format detection.
+  format_context(const char *input = nullptr,
+                 probe_mode mode = probe_mode::full,
+                 const AVInputFormat *input_format = nullptr);
+  // `url` is only used as a hint for probing and in log messages.
+  format_context(std::unique_ptr<io_backend> io, const char *url = nullptr,
+                 probe_mode mode = probe_mode::full);
+  ~format_context();
+
+  format_context(format_context &&) = default;
+  format_context &operator=(format_context &&) = default;
+
+  void find_stream_info();
 
   [[nodiscard]] std::span<stream *> streams() const noexcept;
   [[nodiscard]] std::tuple<std::size_t, const AVCodec *>
@@ -37,6 +59,13 @@ public:
               std::size_t related_stream_nb = npos, int flags = 0) const;
 
   [[nodiscard]] packet_unref_guard read_frame(AVPacket *pkt);
+  // Does not throw; the end of the input is reported as AVERROR_EOF. The
+  // caller owns the packet reference on success.
+  [[nodiscard]] av_expected<void> try_read_frame(AVPacket *pkt) noexcept;
+
+  // Thin wrapper around av_seek_frame. `timestamp` is in the time base of
+  // `stream_index`, or AV_TIME_BASE units if it is npos.
+  void seek(std::size_t stream_index, std::int64_t timestamp, int flags = 0);
 
   [[nodiscard]] cppcoro::generator<packet_ref>
   read_frames(packet *pkt = nullptr) {
@@ -46,16 +75,56 @@ public:
       pkt = &pkt_ptr;
     }
     while (true) {
-      try {
-        co_yield packet_ref{pkt, read_frame(pkt->get())};
-      } catch (ffmpeg_error &err) {
-        if (err.error_code() == AVERROR_EOF) {
-          co_return;
-        }
-
-        throw;
+      auto result = try_read_frame(pkt->get());
+      if (result.is_eof()) {
+        co_return;
       }
+
+      result.value_or_throw(no_throw_nested());
+      co_yield packet_ref{pkt, packet_unref_guard{*pkt}};
     }
   }
+
+private:
+  std::unique_ptr<io_backend> m_io;
+};
+
+struct output_format_context_deleter {
+  void operator()(AVFormatContext *c);
+};
+
+// The muxing side. Streams are added from opened encoders, then the header
+// is written, then packets of every stream in any order: they are buffered
+// and interleaved by dts before being written. The trailer comes last.
+class output_format_context
+    : public std::unique_ptr<AVFormatContext,
+                             output_format_context_deleter> {
+public:
+  // The container is guessed from the extension of `url` unless
+  // `format_name` is given.
+  explicit output_format_context(const char *url,
+                                 const char *format_name = nullptr);
+
+  // Must be called on an encoder before its init(), as some containers want
+  // the codec headers out of band.
+  void prepare_encoder(codec_context &encoder) const;
+  // Adds a stream for the packets of an opened encoder and returns its
+  // index.
+  std::size_t add_stream(const codec_context &encoder);
+
+  // Opens the output, unless the format does its own IO, and writes the
+  // container header. Stream time bases may change here.
+  void write_header();
+  // Takes over the packet reference, even on failure. Its timestamps are in
+  // `time_base`, usually the encoder's, and are rescaled to the stream's.
+  [[nodiscard]] av_expected<void>
+  try_write_packet(AVPacket *pkt, std::size_t stream_index,
+                   AVRational time_base) noexcept;
+  void write_packet(AVPacket *pkt, std::size_t stream_index,
+                    AVRational time_base);
+  // Writes out the packets still held back for interleaving.
+  void write_trailer();
+
+  [[nodiscard]] std::span<stream *> streams() const noexcept;
 };
 } // namespace libved::ffmpeg
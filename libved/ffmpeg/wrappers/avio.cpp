@@ -0,0 +1,46 @@
+#include "avio.hpp"
+#include "common.hpp"
+#include <new>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+namespace libved::ffmpeg {
+void io_context_deleter::operator()(AVIOContext *c) {
+  if (c != nullptr) {
+    av_freep(&c->buffer);
+  }
+  avio_context_free(&c);
+}
+
+io_backend::io_backend(std::size_t buffer_size, bool direct)
+    : m_buffer_size{buffer_size}, m_direct{direct} {}
+
+AVIOContext *io_backend::avio_context() {
+  if (m_context != nullptr) {
+    return m_context.get();
+  }
+
+  auto *buffer = static_cast<unsigned char *>(call_alloc(
+      throw_nested_runtime_error("Unable to allocate AVIOContext buffer"),
+      av_malloc, m_buffer_size));
+  auto *context = avio_alloc_context(
+      buffer, static_cast<int>(m_buffer_size), 0, this,
+      [](void *opaque, std::uint8_t *buf, int buf_size) {
+        return static_cast<io_backend *>(opaque)->read(buf, buf_size);
+      },
+      nullptr,
+      [](void *opaque, std::int64_t offset, int whence) {
+        return static_cast<io_backend *>(opaque)->seek(offset, whence);
+      });
+  if (context == nullptr) {
+    av_free(buffer);
+    throw std::bad_alloc{};
+  }
+
+  context->direct = m_direct ? 1 : 0;
+  m_context.reset(context);
+  return context;
+}
+} // namespace libved::ffmpeg
@@ -0,0 +1,38 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace libved::ffmpeg {
+struct io_context_deleter {
+  void operator()(AVIOContext *c);
+};
+
+using io_context = std::unique_ptr<AVIOContext, io_context_deleter>;
+
+// Custom input for format_context. Implementations return the number of
+// bytes read or an AVERROR code, and follow the AVIOContext seek protocol
+// (including AVSEEK_SIZE).
+class io_backend {
+public:
+  virtual ~io_backend() = default;
+
+  virtual int read(std::uint8_t *buf, int buf_size) = 0;
+  virtual std::int64_t seek(std::int64_t offset, int whence) = 0;
+
+  [[nodiscard]] AVIOContext *avio_context();
+
+protected:
+  io_backend(std::size_t buffer_size = 32768, bool direct = false);
+
+private:
+  std::size_t m_buffer_size;
+  bool m_direct;
+  io_context m_context;
+};
+} // namespace libved::ffmpeg
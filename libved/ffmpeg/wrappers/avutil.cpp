@@ -9,7 +9,16 @@ frame alloc_frame() {
 }
 
 frame::frame(AVFrame *f) : std::unique_ptr<AVFrame, frame_deleter>{f} {}
-void frame_deleter::operator()(AVFrame *f) { av_frame_free(&f); }
+frame::frame(AVFrame *f, std::shared_ptr<recycler<AVFrame>> pool)
+    : std::unique_ptr<AVFrame, frame_deleter>{f,
+                                              frame_deleter{std::move(pool)}} {}
+void frame_deleter::operator()(AVFrame *f) {
+  if (pool != nullptr) {
+    pool->recycle(f);
+  } else {
+    av_frame_free(&f);
+  }
+}
 frame_unref_guard::frame_unref_guard(AVFrame *f) : m_frame{f} {}
 frame_unref_guard::frame_unref_guard(const frame &f)
     : frame_unref_guard{f.get()} {}
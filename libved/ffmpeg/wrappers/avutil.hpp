@@ -8,12 +8,22 @@ extern "C" {
 #include <memory>
 
 namespace libved::ffmpeg {
+// Takes back objects whose owning handle was destroyed, instead of them
+// being freed.
+template <typename T> class recycler {
+public:
+  virtual ~recycler() = default;
+  virtual void recycle(T *object) noexcept = 0;
+};
+
 struct frame_deleter {
+  std::shared_ptr<recycler<AVFrame>> pool;
   void operator()(AVFrame *f);
 };
 class frame : public std::unique_ptr<AVFrame, frame_deleter> {
 public:
   frame(AVFrame* f = nullptr);
+  frame(AVFrame *f, std::shared_ptr<recycler<AVFrame>> pool);
 };
 
 class frame_unref_guard {
@@ -10,6 +10,10 @@
 #include <utility>
 #include <errors.hpp>
 
+extern "C" {
+#include <libavutil/error.h>
+}
+
 namespace libved::ffmpeg {
 class ffmpeg_error : public std::runtime_error {
 public:
@@ -36,6 +40,72 @@ inline void check_error(NestedThrowCallback &&callback, int error) {
   }
 }
 
+struct av_unexpected {
+  int code;
+};
+
+// Outcome of a libav* call that does not throw: either a value or the
+// AVERROR code it failed with.
+template <typename T> class av_expected {
+public:
+  av_expected(T value) : m_value{std::move(value)} {}
+  av_expected(av_unexpected error) : m_error{error.code} {}
+
+  [[nodiscard]] bool has_value() const noexcept { return m_error == 0; }
+  explicit operator bool() const noexcept { return has_value(); }
+  [[nodiscard]] int error() const noexcept { return m_error; }
+  [[nodiscard]] bool is_eof() const noexcept { return m_error == AVERROR_EOF; }
+
+  [[nodiscard]] T &operator*() noexcept { return m_value; }
+  [[nodiscard]] const T &operator*() const noexcept { return m_value; }
+
+  [[nodiscard]] T &value() {
+    throw_if_not_success(m_error);
+    return m_value;
+  }
+
+  // Throws like call_and_handle_error would have.
+  template <std::invocable<> NestedThrowCallback>
+  T &value_or_throw(NestedThrowCallback &&callback) {
+    if (!has_value()) {
+      check_error(std::forward<NestedThrowCallback>(callback), m_error);
+    }
+    return m_value;
+  }
+
+private:
+  T m_value{};
+  int m_error = 0;
+};
+
+template <> class av_expected<void> {
+public:
+  av_expected() = default;
+  av_expected(av_unexpected error) : m_error{error.code} {}
+
+  [[nodiscard]] bool has_value() const noexcept { return m_error == 0; }
+  explicit operator bool() const noexcept { return has_value(); }
+  [[nodiscard]] int error() const noexcept { return m_error; }
+  [[nodiscard]] bool is_eof() const noexcept { return m_error == AVERROR_EOF; }
+
+  void value() const { throw_if_not_success(m_error); }
+
+  template <std::invocable<> NestedThrowCallback>
+  void value_or_throw(NestedThrowCallback &&callback) const {
+    check_error(std::forward<NestedThrowCallback>(callback), m_error);
+  }
+
+private:
+  int m_error = 0;
+};
+
+inline av_expected<void> to_expected(int error) noexcept {
+  if (error < 0) {
+    return av_unexpected{error};
+  }
+  return {};
+}
+
 template <std::invocable<> NestedThrowCallback, typename... Args,
           std::invocable<Args &&...> Func>
 inline void call_and_handle_error(NestedThrowCallback &&callback, Func &&f,
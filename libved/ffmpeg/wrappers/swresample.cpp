@@ -0,0 +1,131 @@
+#include "swresample.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace libved::ffmpeg {
+void resample_context_deleter::operator()(SwrContext *c) { swr_free(&c); }
+
+resample_context::resample_context(int sample_rate, int channels)
+    : m_sample_rate{sample_rate}, m_channels{channels},
+      m_planes(static_cast<std::size_t>(channels)) {
+  if (sample_rate <= 0 || channels <= 0) {
+    throw std::invalid_argument{"Invalid resampler output format"};
+  }
+  av_channel_layout_default(&m_out_layout, channels);
+}
+
+resample_context::~resample_context() {
+  av_channel_layout_uninit(&m_out_layout);
+  av_channel_layout_uninit(&m_in_layout);
+}
+
+// Channel layouts may own a channel map, so they are handed over rather
+// than copied.
+resample_context::resample_context(resample_context &&other) noexcept
+    : std::unique_ptr<SwrContext, resample_context_deleter>{std::move(other)},
+      m_sample_rate{other.m_sample_rate}, m_channels{other.m_channels},
+      m_out_layout{std::exchange(other.m_out_layout, AVChannelLayout{})},
+      m_in_layout{std::exchange(other.m_in_layout, AVChannelLayout{})},
+      m_in_format{other.m_in_format}, m_in_rate{other.m_in_rate},
+      m_buffer{std::move(other.m_buffer)}, m_stride{other.m_stride},
+      m_planes{std::move(other.m_planes)} {}
+
+resample_context &
+resample_context::operator=(resample_context &&other) noexcept {
+  std::unique_ptr<SwrContext, resample_context_deleter>::operator=(
+      std::move(other));
+  m_sample_rate = other.m_sample_rate;
+  m_channels = other.m_channels;
+  std::swap(m_out_layout, other.m_out_layout);
+  std::swap(m_in_layout, other.m_in_layout);
+  m_in_format = other.m_in_format;
+  m_in_rate = other.m_in_rate;
+  m_buffer = std::move(other.m_buffer);
+  m_stride = other.m_stride;
+  m_planes = std::move(other.m_planes);
+  return *this;
+}
+
+void resample_context::configure(const AVFrame &frm) {
+  if (get() != nullptr && frm.format == m_in_format &&
+      frm.sample_rate == m_in_rate &&
+      av_channel_layout_compare(&frm.ch_layout, &m_in_layout) == 0) {
+    return;
+  }
+
+  // Whatever the old configuration still held is dropped.
+  auto *ctx = release();
+  const int ret = swr_alloc_set_opts2(
+      &ctx, &m_out_layout, AV_SAMPLE_FMT_FLTP, m_sample_rate, &frm.ch_layout,
+      static_cast<AVSampleFormat>(frm.format), frm.sample_rate, 0, nullptr);
+  reset(ctx);
+  check_error(throw_nested_runtime_error("Unable to configure SwrContext"),
+              ret);
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to initialise SwrContext"), swr_init,
+      get());
+
+  av_channel_layout_uninit(&m_in_layout);
+  call_and_handle_error(
+      throw_nested_runtime_error("Unable to copy channel layout"),
+      av_channel_layout_copy, &m_in_layout, &frm.ch_layout);
+  m_in_format = frm.format;
+  m_in_rate = frm.sample_rate;
+}
+
+void resample_context::reserve(int samples) {
+  constexpr auto floats_per_line = sample_alignment / sizeof(float);
+  const auto needed = static_cast<std::size_t>(std::max(samples, 1));
+  if (needed <= m_stride) {
+    return;
+  }
+
+  // Grow geometrically so that jittery frame sizes do not reallocate.
+  auto stride = std::max(needed, m_stride * 2);
+  stride = (stride + floats_per_line - 1) / floats_per_line * floats_per_line;
+  m_buffer.reset(static_cast<float *>(::operator new[](
+      stride * m_planes.size() * sizeof(float),
+      std::align_val_t{sample_alignment})));
+  m_stride = stride;
+  for (std::size_t i = 0; i < m_planes.size(); ++i) {
+    m_planes[i] = m_buffer.get() + i * m_stride;
+  }
+}
+
+audio_block resample_context::convert(const std::uint8_t **data,
+                                      int samples) {
+  const int capacity = swr_get_out_samples(get(), samples);
+  check_error(throw_nested_runtime_error("Unable to size resampler output"),
+              capacity < 0 ? capacity : 0);
+  reserve(capacity);
+
+  const int converted = swr_convert(
+      get(), reinterpret_cast<std::uint8_t **>(m_planes.data()),
+      static_cast<int>(m_stride), data, samples);
+  check_error(throw_nested_runtime_error("Unable to resample audio"),
+              converted < 0 ? converted : 0);
+  return {m_planes, converted};
+}
+
+audio_block resample_context::convert(const AVFrame &frm) {
+  configure(frm);
+  return convert(const_cast<const std::uint8_t **>(frm.extended_data),
+                 frm.nb_samples);
+}
+
+audio_block resample_context::flush() {
+  if (get() == nullptr) {
+    return {m_planes, 0};
+  }
+  return convert(nullptr, 0);
+}
+
+std::int64_t resample_context::delay() const {
+  return get() != nullptr ? swr_get_delay(get(), m_sample_rate) : 0;
+}
+
+std::chrono::nanoseconds resample_context::delay_duration() const {
+  return std::chrono::nanoseconds{delay() * 1'000'000'000 / m_sample_rate};
+}
+} // namespace libved::ffmpeg
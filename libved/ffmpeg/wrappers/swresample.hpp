@@ -1,8 +1,88 @@
 #pragma once
 
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libswresample/swresample.h>
+}
+
+#include "common.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+
 namespace libved::ffmpeg {
-  class resample_context {
+// Alignment of every plane handed out by resample_context, enough for
+// 512-bit vectors.
+inline constexpr std::size_t sample_alignment = 64;
+
+struct resample_context_deleter {
+  void operator()(SwrContext *c);
+};
+
+// Planar float samples owned by a resample_context. Valid until the next
+// call on that context.
+struct audio_block {
+  std::span<float *const> planes;
+  int samples = 0;
+
+  [[nodiscard]] std::span<float> channel(std::size_t index) const {
+    return {planes[index], static_cast<std::size_t>(samples)};
+  }
+};
+
+// Converts decoded audio of any layout, sample format and rate to planar
+// float with a fixed channel count and rate, the format the mixer works in.
+// The input format may change between frames.
+class resample_context
+    : public std::unique_ptr<SwrContext, resample_context_deleter> {
+public:
+  explicit resample_context(int sample_rate = 48000, int channels = 2);
+  ~resample_context();
+
+  resample_context(resample_context &&other) noexcept;
+  resample_context &operator=(resample_context &&other) noexcept;
 
+  // Converts one decoded frame. The result may hold fewer or more samples
+  // than the frame, as the resampler keeps some back.
+  audio_block convert(const AVFrame &frm);
+  // Returns what the resampler still holds, e.g. at the end of a stream.
+  audio_block flush();
+
+  // Samples held back by the resampler, in output samples.
+  [[nodiscard]] std::int64_t delay() const;
+  [[nodiscard]] std::chrono::nanoseconds delay_duration() const;
+
+  [[nodiscard]] int sample_rate() const noexcept { return m_sample_rate; }
+  [[nodiscard]] int channels() const noexcept { return m_channels; }
+
+private:
+  struct aligned_delete {
+    void operator()(float *p) const {
+      ::operator delete[](p, std::align_val_t{sample_alignment});
+    }
   };
-}
 
+  void configure(const AVFrame &frm);
+  void reserve(int samples);
+  audio_block convert(const std::uint8_t **data, int samples);
+
+  int m_sample_rate;
+  int m_channels;
+  AVChannelLayout m_out_layout{};
+
+  // Input format the context is configured for.
+  AVChannelLayout m_in_layout{};
+  int m_in_format = AV_SAMPLE_FMT_NONE;
+  int m_in_rate = 0;
+
+  std::unique_ptr<float, aligned_delete> m_buffer;
+  // Capacity per plane, in samples; planes are this far apart.
+  std::size_t m_stride = 0;
+  std::vector<float *> m_planes;
+};
+} // namespace libved::ffmpeg
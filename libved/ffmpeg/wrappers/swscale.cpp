@@ -0,0 +1,51 @@
+#include "swscale.hpp"
+
+namespace libved::ffmpeg {
+void scale_context_deleter::operator()(SwsContext *c) { sws_freeContext(c); }
+
+scale_context::scale_context(int flags) : m_flags{flags} {}
+
+void scale_context::set_colorspace(int colorspace, bool src_full_range,
+                                   bool dst_full_range) {
+  if (colorspace == m_colorspace && src_full_range == m_src_full_range &&
+      dst_full_range == m_dst_full_range) {
+    return;
+  }
+  m_colorspace = colorspace;
+  m_src_full_range = src_full_range;
+  m_dst_full_range = dst_full_range;
+  m_colorspace_pending = true;
+}
+
+void scale_context::scale(const AVFrame &src, int width, int height,
+                          AVPixelFormat format, std::uint8_t *const data[4],
+                          const int linesize[4]) {
+  auto *ctx = call_alloc(
+      throw_nested_runtime_error("Unable to create SwsContext"),
+      sws_getCachedContext, release(), src.width, src.height,
+      static_cast<AVPixelFormat>(src.format), width, height, format, m_flags,
+      nullptr, nullptr, nullptr);
+  reset(ctx);
+
+  const std::array geometry{src.width, src.height, src.format,
+                            width,     height,     static_cast<int>(format)};
+  if (geometry != m_geometry) {
+    m_geometry = geometry;
+    m_colorspace_pending = m_colorspace != SWS_CS_DEFAULT;
+  }
+  if (m_colorspace_pending) {
+    const auto *coefficients = sws_getCoefficients(m_colorspace);
+    if (sws_setColorspaceDetails(get(), coefficients, m_src_full_range,
+                                 coefficients, m_dst_full_range, 0, 1 << 16,
+                                 1 << 16) < 0) {
+      throw std::runtime_error{"Unable to set the scaling colorspace"};
+    }
+    m_colorspace_pending = false;
+  }
+
+  const int ret = sws_scale(get(), src.data, src.linesize, 0, src.height,
+                            data, linesize);
+  check_error(throw_nested_runtime_error("Unable to scale picture"),
+              ret < 0 ? ret : 0);
+}
+} // namespace libved::ffmpeg
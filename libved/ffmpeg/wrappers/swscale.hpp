@@ -0,0 +1,42 @@
+#pragma once
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+#include "avutil.hpp"
+#include "common.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace libved::ffmpeg {
+struct scale_context_deleter {
+  void operator()(SwsContext *c);
+};
+
+// Converts and resizes pictures with libswscale. The underlying context is
+// only rebuilt when the source or destination geometry changes.
+class scale_context
+    : public std::unique_ptr<SwsContext, scale_context_deleter> {
+public:
+  explicit scale_context(int flags = SWS_AREA);
+
+  // YUV matrix (one of SWS_CS_*) and ranges of conversions between YUV and
+  // RGB. Without it libswscale assumes BT.601 limited range.
+  void set_colorspace(int colorspace, bool src_full_range,
+                      bool dst_full_range);
+
+  void scale(const AVFrame &src, int width, int height, AVPixelFormat format,
+             std::uint8_t *const data[4], const int linesize[4]);
+
+private:
+  int m_flags;
+  int m_colorspace = SWS_CS_DEFAULT;
+  bool m_src_full_range = false;
+  bool m_dst_full_range = false;
+  // A rebuilt context starts with the default colorspace again.
+  std::array<int, 6> m_geometry{};
+  bool m_colorspace_pending = false;
+};
+} // namespace libved::ffmpeg
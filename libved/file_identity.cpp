@@ -0,0 +1,27 @@
+#include "file_identity.hpp"
+#include <cerrno>
+#include <fmt/core.h>
+#include <sys/stat.h>
+#include <system_error>
+
+namespace libved {
+file_identity file_identity::of(const char *path) {
+  struct stat st {};
+  if (stat(path, &st) != 0) {
+    throw std::system_error{errno, std::generic_category(),
+                            fmt::format("Unable to stat '{}'", path)};
+  }
+
+  return {
+      .device = static_cast<std::uint64_t>(st.st_dev),
+      .inode = static_cast<std::uint64_t>(st.st_ino),
+      .size = static_cast<std::uint64_t>(st.st_size),
+      .mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+                  st.st_mtim.tv_nsec,
+  };
+}
+
+std::string file_identity::to_string() const {
+  return fmt::format("{:x}-{:x}-{:x}-{:x}", device, inode, size, mtime_ns);
+}
+} // namespace libved
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <string>
+
+namespace libved {
+// Identifies one version of a file on disk, so that caches keyed by it are
+// invalidated when the file is replaced or modified.
+struct file_identity {
+  std::uint64_t device = 0;
+  std::uint64_t inode = 0;
+  std::uint64_t size = 0;
+  std::int64_t mtime_ns = 0;
+
+  static file_identity of(const char *path);
+
+  [[nodiscard]] std::string to_string() const;
+
+  auto operator<=>(const file_identity &) const = default;
+};
+} // namespace libved
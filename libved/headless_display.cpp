@@ -0,0 +1,212 @@
+#include "headless_display.hpp"
+#include <algorithm>
+#include <array>
+#include <dlfcn.h>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string_view>
+
+namespace libved::headless {
+namespace {
+// glad replaces the EGL entry points with its own pointers, so the loader
+// it is bootstrapped with comes straight from libEGL.
+GLADapiproc load_egl(const char *name) {
+  using get_proc_address = GLADapiproc (*)(const char *);
+  static const auto get = reinterpret_cast<get_proc_address>(
+      dlsym(RTLD_DEFAULT, "eglGetProcAddress"));
+  if (get == nullptr) {
+    return nullptr;
+  }
+  if (auto *proc = get(name); proc != nullptr) {
+    return proc;
+  }
+  // Implementations without EGL_KHR_get_all_proc_addresses only return
+  // extension functions.
+  return reinterpret_cast<GLADapiproc>(dlsym(RTLD_DEFAULT, name));
+}
+
+bool has_extension(const char *extensions, std::string_view name) {
+  if (extensions == nullptr) {
+    return false;
+  }
+  std::string_view list{extensions};
+  for (std::size_t pos = 0; pos < list.size();) {
+    const auto end = std::min(list.find(' ', pos), list.size());
+    if (list.substr(pos, end - pos) == name) {
+      return true;
+    }
+    pos = end + 1;
+  }
+  return false;
+}
+
+[[noreturn]] void throw_egl_error(const char *what) {
+  throw std::runtime_error{
+      fmt::format("{}: EGL error {:#x}", what, eglGetError())};
+}
+
+EGLDisplay open_display() {
+  const auto *client_extensions =
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  // Surfaceless needs neither a window system nor a DRM device, so it also
+  // works with llvmpipe on machines without a GPU.
+  if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    auto *display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                          EGL_DEFAULT_DISPLAY, nullptr);
+    if (display != EGL_NO_DISPLAY) {
+      return display;
+    }
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+} // namespace
+
+offscreen_frame::offscreen_frame(offscreen &owner) : m_owner(owner) {
+  glBindFramebuffer(GL_FRAMEBUFFER, m_owner.m_framebuffer);
+  glViewport(0, 0, static_cast<GLsizei>(m_owner.m_size.width),
+             static_cast<GLsizei>(m_owner.m_size.height));
+}
+
+offscreen_frame::~offscreen_frame() {
+  // Nothing is presented; flushing keeps the queue of submitted frames
+  // from growing without bound.
+  glFlush();
+  ++m_owner.m_frames;
+}
+
+offscreen::offscreen(const display_params &params)
+    : m_size{params.size
+                 .or_else([] {
+                   spdlog::warn(
+                       "No render size specified, defaulting to 640x360");
+                   return extent2d{640, 360};
+                 })
+                 .value()} {
+  try {
+    init();
+  } catch (...) {
+    release();
+    throw;
+  }
+  if (params.fps.has_value()) {
+    spdlog::debug("Offscreen display ignores the requested {}fps",
+                  *params.fps);
+  }
+}
+
+void offscreen::init() {
+  if (!gladLoadEGL(EGL_NO_DISPLAY, load_egl)) {
+    throw std::runtime_error{"Unable to load EGL functions"};
+  }
+  m_display = open_display();
+  EGLint major = 0;
+  EGLint minor = 0;
+  if (m_display == EGL_NO_DISPLAY ||
+      !eglInitialize(m_display, &major, &minor)) {
+    throw_egl_error("Unable to initialise EGL display");
+  }
+  if (!gladLoadEGL(m_display, load_egl)) {
+    throw std::runtime_error{"Unable to load EGL functions"};
+  }
+  spdlog::info("Headless EGL {}.{}: {}", major, minor,
+               eglQueryString(m_display, EGL_VENDOR));
+
+  const bool surfaceless =
+      has_extension(eglQueryString(m_display, EGL_EXTENSIONS),
+                    "EGL_KHR_surfaceless_context");
+  const std::array<EGLint, 13> config_attributes{
+      EGL_SURFACE_TYPE,
+      surfaceless ? 0 : EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE,
+      EGL_OPENGL_ES3_BIT,
+      EGL_RED_SIZE,
+      8,
+      EGL_GREEN_SIZE,
+      8,
+      EGL_BLUE_SIZE,
+      8,
+      EGL_ALPHA_SIZE,
+      8,
+      EGL_NONE,
+  };
+  EGLConfig config = nullptr;
+  EGLint config_count = 0;
+  if (!eglBindAPI(EGL_OPENGL_ES_API) ||
+      !eglChooseConfig(m_display, config_attributes.data(), &config, 1,
+                       &config_count) ||
+      config_count == 0) {
+    throw_egl_error("No EGL config for offscreen OpenGL ES 3 rendering");
+  }
+
+  const std::array<EGLint, 5> context_attributes{
+      EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2, EGL_NONE};
+  m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT,
+                               context_attributes.data());
+  if (m_context == EGL_NO_CONTEXT) {
+    throw_egl_error("Unable to create OpenGL ES 3.2 context");
+  }
+  if (!surfaceless) {
+    const std::array<EGLint, 5> pbuffer_attributes{EGL_WIDTH, 1, EGL_HEIGHT,
+                                                   1, EGL_NONE};
+    m_surface =
+        eglCreatePbufferSurface(m_display, config, pbuffer_attributes.data());
+    if (m_surface == EGL_NO_SURFACE) {
+      throw_egl_error("Unable to create pbuffer surface");
+    }
+  }
+  if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+    throw_egl_error("Unable to make offscreen context current");
+  }
+  if (!gladLoadGLES2(load_egl)) {
+    throw std::runtime_error{"Unable to load OpenGL functions"};
+  }
+
+  glGenRenderbuffers(1, &m_color);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8,
+                        static_cast<GLsizei>(m_size.width),
+                        static_cast<GLsizei>(m_size.height));
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, m_color);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    throw std::runtime_error{"Offscreen framebuffer is incomplete"};
+  }
+  glViewport(0, 0, static_cast<GLsizei>(m_size.width),
+             static_cast<GLsizei>(m_size.height));
+}
+
+offscreen::~offscreen() { release(); }
+
+void offscreen::release() {
+  if (m_framebuffer != 0) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_color != 0) {
+    glDeleteRenderbuffers(1, &m_color);
+  }
+  if (m_display == EGL_NO_DISPLAY) {
+    return;
+  }
+  eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (m_surface != EGL_NO_SURFACE) {
+    eglDestroySurface(m_display, m_surface);
+  }
+  if (m_context != EGL_NO_CONTEXT) {
+    eglDestroyContext(m_display, m_context);
+  }
+  eglTerminate(m_display);
+  m_display = EGL_NO_DISPLAY;
+}
+
+bool offscreen::is_rendering() const { return true; }
+bool offscreen::is_done() const { return false; }
+
+extent2d offscreen::framebuffer_size() const { return m_size; }
+
+std::unique_ptr<display_frame> offscreen::new_frame() {
+  return std::make_unique<offscreen_frame>(*this);
+}
+} // namespace libved::headless
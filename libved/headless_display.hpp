@@ -0,0 +1,58 @@
+#pragma once
+
+#include "display.hpp"
+#include <cstdint>
+#include <glad/egl.h>
+#include <glad/gles2.h>
+#include <memory>
+
+namespace libved::headless {
+class offscreen;
+class offscreen_frame : public display_frame {
+public:
+  offscreen_frame(offscreen &owner);
+  ~offscreen_frame();
+
+private:
+  offscreen &m_owner;
+};
+
+// Renders into a framebuffer object of an EGL context that has no window,
+// surfaceless where the driver allows it and on a 1x1 pbuffer otherwise.
+// Needs no X server or GPU: Mesa's llvmpipe is enough. Frames are not
+// paced, so the pipeline runs as fast as it can.
+class offscreen : public display {
+public:
+  offscreen(const display_params &params);
+  ~offscreen() override;
+
+  offscreen(const offscreen &) = delete;
+  offscreen &operator=(const offscreen &) = delete;
+
+  bool is_rendering() const override;
+  bool is_done() const override;
+
+  extent2d framebuffer_size() const override;
+  std::unique_ptr<display_frame> new_frame() override;
+
+  // The framebuffer frames are drawn into, e.g. to read them back.
+  [[nodiscard]] GLuint framebuffer() const noexcept { return m_framebuffer; }
+  [[nodiscard]] std::uint64_t frames_rendered() const noexcept {
+    return m_frames;
+  }
+
+private:
+  friend class offscreen_frame;
+
+  void init();
+  void release();
+
+  extent2d m_size;
+  EGLDisplay m_display = EGL_NO_DISPLAY;
+  EGLContext m_context = EGL_NO_CONTEXT;
+  EGLSurface m_surface = EGL_NO_SURFACE;
+  GLuint m_framebuffer = 0;
+  GLuint m_color = 0;
+  std::uint64_t m_frames = 0;
+};
+} // namespace libved::headless
@@ -1,9 +1,18 @@
+#include "audio_mixer.hpp"
+#include "audio_output.hpp"
 #include "display.hpp"
+#include "ffmpeg/audio_source.hpp"
+#include "ffmpeg/av_sync.hpp"
+#include "ffmpeg/demuxer.hpp"
+#include "ffmpeg/frame_queue.hpp"
+#include "ffmpeg/pools.hpp"
+#include "ffmpeg/thread_tuner.hpp"
 #include "ffmpeg/vaapi.hpp"
 #include "ffmpeg/wrappers/avcodec.hpp"
 #include "ffmpeg/wrappers/avformat.hpp"
 #include "ffmpeg/wrappers/avutil.hpp"
 #include "ffmpeg/wrappers/common.hpp"
+#include "playback_clock.hpp"
 #include "vkfw/vkfw.hpp"
 #include <chrono>
 #include <cstdint>
@@ -60,29 +69,157 @@ void packet_thread(const char* path) {
       spdlog::info("Using HW decoding: {}",
                    av_hwdevice_get_type_name(hwtype.value()));
       cc.set_format_callback([](auto...) { return AV_PIX_FMT_VAAPI; });
+    } else {
+      libved::ffmpeg::thread_tuner tuner;
+      cc.set_threading(tuner.policy_for(
+          path, video_stream_index, libved::ffmpeg::decode_goal::latency));
+      cc.set_frame_pool(std::make_shared<libved::ffmpeg::frame_pool>());
     }
+    const libved::ffmpeg::frame_queue_params queue_params;
+    // The decoder's surface pool must also cover the frames decoded ahead.
+    cc->extra_hw_frames = static_cast<int>(queue_params.depth) + 1;
     cc.init();
     auto vsi = video_stream_index;
-    auto frame = libved::ffmpeg::alloc_frame();
-    for (auto &&[pkt, guard] : fc.read_frames()) {
-      if (pkt->get()->stream_index != vsi) {
-        continue;
+    libved::ffmpeg::frame_pool decoded_frames;
+    libved::ffmpeg::frame_pool drm_frames;
+    libved::vaapi::pbo_uploader uploader;
+    libved::ffmpeg::frame_queue frames{fc.streams()[vsi]->time_base,
+                                       queue_params};
+    libved::ffmpeg::demuxer demux{fc};
+    auto &video_queue = demux.open_stream(vsi);
+
+    const auto asi = std::get<0>(fc.find_stream(
+        AVMEDIA_TYPE_AUDIO, libved::ffmpeg::format_context::npos, vsi));
+    std::unique_ptr<libved::ffmpeg::codec_context> acc;
+    std::unique_ptr<libved::ffmpeg::decoded_audio_source> audio_source;
+    libved::audio_mixer mixer;
+    std::unique_ptr<libved::audio_output> audio;
+    libved::ffmpeg::packet_queue *audio_queue = nullptr;
+    if (asi != libved::ffmpeg::format_context::npos) {
+      audio_queue = &demux.open_stream(asi);
+      try {
+        acc = std::make_unique<libved::ffmpeg::codec_context>(
+            *fc.streams()[asi]);
+        acc->init();
+        audio_source = std::make_unique<libved::ffmpeg::decoded_audio_source>(
+            *acc, *audio_queue);
+        mixer.add_track(
+            [&](std::span<float *const> planes, std::size_t samples) {
+              return audio_source->read(planes, samples);
+            });
+        audio = std::make_unique<libved::audio_output>(
+            [&](std::span<float *const> planes, std::size_t samples) {
+              return mixer.mix(planes, samples);
+            });
+        spdlog::info("Mixing audio with the {} kernel",
+                     libved::audio_mixer::kernel_name());
+      } catch (std::exception &ex) {
+        print_exception(ex);
+        spdlog::warn("Playing without audio");
+        demux.discard_stream(asi);
+      }
+    }
+    demux.start();
+    if (audio != nullptr) {
+      audio->start();
+    }
+    std::jthread decode_thread{[&] {
+      try {
+        auto pkt = libved::ffmpeg::alloc_packet();
+        while (true) {
+          using enum libved::ffmpeg::queue_result;
+          const auto result = video_queue.pop(pkt);
+          if (result == flush) {
+            cc.flush_buffers();
+            frames.clear();
+            continue;
+          }
+          if (result != success) {
+            break;
+          }
+
+          libved::ffmpeg::packet_unref_guard guard{pkt};
+          cc.send_packet(pkt);
+          auto frame = decoded_frames.get();
+          while (cc.receive_frame(frame) ==
+                 libved::ffmpeg::send_receive_result::success) {
+            if (!frames.push(std::move(frame))) {
+              return;
+            }
+            frame = decoded_frames.get();
+          }
+        }
+      } catch (std::exception &ex) {
+        print_exception(ex);
+      }
+      frames.finish();
+    }};
+
+    struct stop_decoding {
+      libved::ffmpeg::frame_queue &frames;
+      libved::ffmpeg::packet_queue &packets;
+      libved::ffmpeg::packet_queue *audio_packets;
+      ~stop_decoding() {
+        frames.abort();
+        packets.abort();
+        if (audio_packets != nullptr) {
+          audio_packets->abort();
+        }
       }
+    } stop{frames, video_queue, audio_queue};
 
-      cc.send_packet(*pkt);
-      while (cc.receive_frame(frame) ==
-             libved::ffmpeg::send_receive_result::success) {
-        auto nv12 = libved::vaapi::map_nv12_frame(std::move(frame));
-        auto dpl_frame = dpl->new_frame();
-        glClearColor(0.2F, 0.3F, 0.3F, 1.0F);
-        glClear(GL_COLOR_BUFFER_BIT);
+    const auto first_frame = frames.wait_next_time();
+    if (!first_frame.has_value()) {
+      return;
+    }
+    // Video follows the audio being heard; without audio, wall time since
+    // the first frame, offset by its pts.
+    std::unique_ptr<libved::playback_clock> clock;
+    if (audio != nullptr) {
+      clock = std::make_unique<libved::audio_clock>(
+          [&] { return audio_source->time_at(audio->played_samples()); },
+          *first_frame);
+    } else {
+      clock = std::make_unique<libved::monotonic_clock>(*first_frame);
+    }
+    libved::ffmpeg::sync_monitor sync;
+    tl::optional<libved::vaapi::guarded_texture> shown;
+    while (!frames.finished()) {
+      const auto position = clock->now();
+      const auto next = frames.frame_for(position);
+      sync.on_refresh(position, next);
+      if (next.changed) {
+        shown.reset();
+        shown.emplace(hwtype.has_value()
+                          ? libved::vaapi::map_nv12_frame(*next.frm,
+                                                          &drm_frames)
+                          : libved::vaapi::guarded_texture{
+                                .tex = uploader.upload(**next.frm)});
+      }
+      auto dpl_frame = dpl->new_frame();
+      glClearColor(0.2F, 0.3F, 0.3F, 1.0F);
+      glClear(GL_COLOR_BUFFER_BIT);
+      if (shown.has_value()) {
         vao.bind();
-        std::get<libved::vaapi::nv12_texture>(nv12.tex).bind_units(0, 1);
+        libved::vaapi::bind_units(shown->tex, 0, 1);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        if(dpl->is_done()) {
-          return;
-        }
       }
+      if(dpl->is_done()) {
+        break;
+      }
+    }
+
+    const auto stats = frames.stats();
+    spdlog::info("Presented {} frames: {} dropped, {} duplicated, {} late",
+                 stats.presented, stats.dropped, stats.duplicated,
+                 stats.late);
+    sync.report();
+    if (audio != nullptr) {
+      const auto audio_stats = audio->stats();
+      spdlog::info("Played {} audio buffers: {} underruns, at least {} "
+                   "queued",
+                   audio_stats.buffers_played, audio_stats.underruns,
+                   audio_stats.min_queued_buffers);
     }
   } catch (std::exception &ex) {
     print_exception(ex);
@@ -0,0 +1,71 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <algorithm>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace libved {
+mapped_file::mapped_file(const char *path) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error{errno, std::generic_category(),
+                            fmt::format("Unable to open '{}'", path)};
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    const auto err = errno;
+    close(fd);
+    throw std::system_error{err, std::generic_category(),
+                            fmt::format("Unable to stat '{}'", path)};
+  }
+
+  m_size = static_cast<std::size_t>(st.st_size);
+  if (m_size == 0) {
+    close(fd);
+    throw std::runtime_error{fmt::format("Unable to map empty file '{}'", path)};
+  }
+
+  void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  const auto err = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::system_error{err, std::generic_category(),
+                            fmt::format("Unable to map '{}'", path)};
+  }
+  m_data = static_cast<const std::uint8_t *>(data);
+}
+
+mapped_file::~mapped_file() {
+  if (m_data != nullptr) {
+    munmap(const_cast<std::uint8_t *>(m_data), m_size);
+  }
+}
+
+mapped_file::mapped_file(mapped_file &&rhs) noexcept
+    : m_data{std::exchange(rhs.m_data, nullptr)},
+      m_size{std::exchange(rhs.m_size, 0)} {}
+
+mapped_file &mapped_file::operator=(mapped_file &&rhs) noexcept {
+  std::swap(m_data, rhs.m_data);
+  std::swap(m_size, rhs.m_size);
+  return *this;
+}
+
+void mapped_file::advise(std::size_t offset, std::size_t length,
+                         int advice) const {
+  static const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = offset / page_size * page_size;
+  const auto end = std::min(m_size, offset + length);
+  if (begin < end) {
+    madvise(const_cast<std::uint8_t *>(m_data) + begin, end - begin, advice);
+  }
+}
+} // namespace libved
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace libved {
+// Read-only private mapping of a whole file.
+class mapped_file {
+public:
+  explicit mapped_file(const char *path);
+  ~mapped_file();
+
+  mapped_file(mapped_file &&rhs) noexcept;
+  mapped_file &operator=(mapped_file &&rhs) noexcept;
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  [[nodiscard]] const std::uint8_t *data() const noexcept { return m_data; }
+  [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+  [[nodiscard]] std::span<const std::byte> bytes() const noexcept {
+    return {reinterpret_cast<const std::byte *>(m_data), m_size};
+  }
+
+  void advise(std::size_t offset, std::size_t length, int advice) const;
+
+private:
+  const std::uint8_t *m_data = nullptr;
+  std::size_t m_size = 0;
+};
+} // namespace libved
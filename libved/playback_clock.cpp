@@ -0,0 +1,39 @@
+#include "playback_clock.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace libved {
+monotonic_clock::monotonic_clock(std::chrono::nanoseconds start)
+    : m_start{start}, m_epoch{std::chrono::steady_clock::now()} {}
+
+std::chrono::nanoseconds monotonic_clock::now() {
+  return m_start + (std::chrono::steady_clock::now() - m_epoch);
+}
+
+audio_clock::audio_clock(position_source position,
+                         std::chrono::nanoseconds start,
+                         audio_clock_params params)
+    : m_position{std::move(position)}, m_params{params}, m_last{start},
+      m_last_time{std::chrono::steady_clock::now()} {}
+
+std::chrono::nanoseconds audio_clock::now() {
+  const auto wall = std::chrono::steady_clock::now();
+  const auto position = m_position();
+  std::chrono::nanoseconds estimate;
+  if (position.has_value()) {
+    if (*position != m_device_position) {
+      m_device_position = *position;
+      m_device_time = wall;
+    }
+    estimate = m_device_position +
+               std::min<std::chrono::nanoseconds>(wall - m_device_time,
+                                                  m_params.max_extrapolation);
+  } else {
+    estimate = m_last + (wall - m_last_time);
+  }
+
+  m_last = std::max(m_last, estimate);
+  m_last_time = wall;
+  return m_last;
+}
+} // namespace libved
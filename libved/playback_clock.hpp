@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <tl/optional.hpp>
+
+namespace libved {
+// Stream time that presentation follows.
+class playback_clock {
+public:
+  virtual ~playback_clock() = default;
+
+  [[nodiscard]] virtual std::chrono::nanoseconds now() = 0;
+};
+
+// Runs at the rate of std::chrono::steady_clock, from `start` at
+// construction.
+class monotonic_clock : public playback_clock {
+public:
+  explicit monotonic_clock(std::chrono::nanoseconds start = {});
+
+  [[nodiscard]] std::chrono::nanoseconds now() override;
+
+private:
+  std::chrono::nanoseconds m_start;
+  std::chrono::steady_clock::time_point m_epoch;
+};
+
+struct audio_clock_params {
+  // How far the clock may run ahead of the last device position. The
+  // device reports progress in periods, so the clock interpolates between
+  // them, but a stalled device must stall the clock too.
+  std::chrono::nanoseconds max_extrapolation = std::chrono::milliseconds{60};
+};
+
+// Follows the stream time of the audio the device is playing, so that
+// video presented against it stays in sync with what is heard, however
+// far the audio device's clock drifts from the system's. Never runs
+// backwards. Where `position` has no answer, e.g. before the audio starts
+// or after it ends, it runs on like a monotonic_clock.
+class audio_clock : public playback_clock {
+public:
+  using position_source =
+      std::function<tl::optional<std::chrono::nanoseconds>()>;
+
+  audio_clock(position_source position, std::chrono::nanoseconds start = {},
+              audio_clock_params params = {});
+
+  [[nodiscard]] std::chrono::nanoseconds now() override;
+
+private:
+  position_source m_position;
+  audio_clock_params m_params;
+
+  std::chrono::nanoseconds m_device_position{-1};
+  std::chrono::steady_clock::time_point m_device_time;
+  std::chrono::nanoseconds m_last;
+  std::chrono::steady_clock::time_point m_last_time;
+};
+} // namespace libved
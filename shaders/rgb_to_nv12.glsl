@@ -0,0 +1,55 @@
+#type vertex
+
+#version 320 es
+
+void main()
+{
+  // One triangle covering the whole target.
+  vec2 pos = vec2(float((gl_VertexID & 1) << 2) - 1.0,
+                  float((gl_VertexID & 2) << 1) - 1.0);
+  gl_Position = vec4(pos, 0.0, 1.0);
+}
+
+#type fragment
+
+#version 320 es
+precision highp float;
+
+layout (binding = 0) uniform sampler2D source;
+// 0 renders the luma plane, 1 the interleaved chroma plane.
+uniform int plane;
+
+layout(location = 0) out vec4 packed_bytes;
+
+// BT.709 limited range, the inverse of basic_shader's yuv2rgb.
+const vec3 y_coeffs = vec3(0.1826, 0.6142, 0.0620);
+const vec3 u_coeffs = vec3(-0.1006, -0.3386, 0.4392);
+const vec3 v_coeffs = vec3(0.4392, -0.3989, -0.0402);
+
+vec3 rgb_at(vec2 texel)
+{
+  return texture(source, texel / vec2(textureSize(source, 0))).rgb;
+}
+
+// Every output texel packs four bytes of the plane, so that reading it back
+// only needs RGBA, which every implementation supports.
+void main()
+{
+  vec2 pos = floor(gl_FragCoord.xy);
+  if (plane == 0) {
+    vec2 base = vec2(pos.x * 4.0, pos.y) + 0.5;
+    packed_bytes = vec4(dot(rgb_at(base), y_coeffs),
+                        dot(rgb_at(base + vec2(1.0, 0.0)), y_coeffs),
+                        dot(rgb_at(base + vec2(2.0, 0.0)), y_coeffs),
+                        dot(rgb_at(base + vec2(3.0, 0.0)), y_coeffs))
+                   + 16.0 / 255.0;
+  } else {
+    // Sampling the middle of each 2x2 block averages it.
+    vec2 base = vec2(pos.x * 4.0, pos.y * 2.0) + 1.0;
+    vec3 a = rgb_at(base);
+    vec3 b = rgb_at(base + vec2(2.0, 0.0));
+    packed_bytes = vec4(dot(a, u_coeffs), dot(a, v_coeffs),
+                        dot(b, u_coeffs), dot(b, v_coeffs))
+                   + 128.0 / 255.0;
+  }
+}